@@ -0,0 +1,205 @@
+# bank_diff.py
+# Host side diff generator for the PATCH OTA command, see lib/libota/include/ota_patch.h.
+# Rebuilds the new bank image from the image in the running bank, page by page.
+# Author: Iluna Angelic47 <admin@angelic47.com>
+# SPDX-License-Identifier: Apache-2.0
+#
+# Usage: python bank_diff.py <running firmware.bin> <new firmware.bin> <target bank entry address> <output file> [io buffer size]
+# Both images are the per-bank build outputs, e.g. buildPartitionA/firmware.bin of the running release
+# and buildPartitionB/firmware.bin of the new release when Bank A is running.
+# The output file is a list of records, each one PATCH command:
+#   address (4 bytes LE) + patched length (4 bytes LE) + patch length (2 bytes LE) + patch instructions
+# Every command only depends on the running bank, so an interrupted update resumes by erasing the
+# page it stopped in and sending the commands of that page again. Commands never cross a page.
+
+import struct
+import sys
+
+OP_COPY = 0x01
+OP_INSERT = 0x02
+OP_DIFF = 0x03
+
+RUN_UNCHANGED = 0x80
+MAX_RUN = 0x80
+
+PAGE_SIZE = 4096 # EEPROM_BLOCK_SIZE, the flash erase unit
+BLOCK = 8        # Bytes hashed to find copy candidates
+MIN_COPY = 16    # Shorter matches are cheaper as part of a DIFF or INSERT
+MAX_CANDIDATES = 8
+
+fill_byte = 0xFF
+
+
+def _encode_deltas(old, new):
+    """Delta runs of a DIFF instruction for new against old."""
+    out = bytearray()
+    i = 0
+    while i < len(new):
+        if old[i] == new[i]:
+            run = 1
+            while i + run < len(new) and run < MAX_RUN and old[i + run] == new[i + run]:
+                run += 1
+            out.append(RUN_UNCHANGED + run - 1)
+        else:
+            # Short equal stretches inside a delta run cost less than a new control byte
+            run = 1
+            while i + run < len(new) and run < MAX_RUN and (old[i + run] != new[i + run] or
+                    (i + run + 1 < len(new) and old[i + run + 1] != new[i + run + 1])):
+                run += 1
+            out.append(run - 1)
+            out.extend((new[i + k] - old[i + k]) & 0xFF for k in range(run))
+        i += run
+    return bytes(out)
+
+
+class Differ:
+    def __init__(self, old):
+        self.old = old
+        self.hint = None # Displacement of the last copy, code tends to move in blocks
+        self.index = {}
+        for i in range(0, len(old) - BLOCK + 1):
+            entry = self.index.setdefault(old[i:i + BLOCK], [])
+            if len(entry) < MAX_CANDIDATES:
+                entry.append(i)
+
+    def _match_length(self, src, new, pos, end):
+        length = 0
+        while pos + length < end and src + length < len(self.old) and self.old[src + length] == new[pos + length]:
+            length += 1
+        return length
+
+    def find_copy(self, new, pos, end, hint):
+        """Longest exact match of new[pos:end] in the running image, trying the last displacement first."""
+        best_length, best_src = 0, 0
+        candidates = list(self.index.get(bytes(new[pos:pos + BLOCK]), []))
+        if hint is not None and 0 <= pos + hint < len(self.old):
+            candidates.insert(0, pos + hint)
+        for src in candidates:
+            length = self._match_length(src, new, pos, end)
+            if length > best_length:
+                best_length, best_src = length, src
+        # Keep instruction boundaries on words, so commands can be split anywhere between them
+        return best_length & ~0x03, best_src
+
+    def gap_instruction(self, new, start, end, hint):
+        """Cheapest of INSERT and DIFF (at the last displacement) for new[start:end]."""
+        data = bytes(new[start:end])
+        best = bytes([OP_INSERT]) + struct.pack("<H", len(data)) + data
+        if hint is not None and 0 <= start + hint and end + hint <= len(self.old):
+            deltas = _encode_deltas(self.old[start + hint:end + hint], data)
+            diff = bytes([OP_DIFF]) + struct.pack("<IH", start + hint, len(data)) + deltas
+            if len(diff) < len(best):
+                best = diff
+        return best
+
+    def page_instructions(self, new, start, end, max_instruction):
+        """Instructions rebuilding new[start:end], each one word aligned and at most max_instruction bytes."""
+        instructions = []
+        hint = self.hint
+        pos = start
+        # Worst case INSERT, 3 bytes of header, keeps every gap instruction within max_instruction
+        max_gap = (max_instruction - 8) & ~0x03
+        while pos < end:
+            length, src = self.find_copy(new, pos, end, hint)
+            if length >= MIN_COPY:
+                length = min(length, 0xFFFC)
+                instructions.append((length, bytes([OP_COPY]) + struct.pack("<IH", src, length)))
+                hint = src - pos
+                pos += length
+                continue
+            gap_end = pos + 4
+            while gap_end < end and gap_end - pos < max_gap:
+                if self.find_copy(new, gap_end, end, hint)[0] >= MIN_COPY:
+                    break
+                gap_end += 4
+            instructions.append((gap_end - pos, self.gap_instruction(new, pos, gap_end, hint)))
+            pos = gap_end
+        self.hint = hint
+        return instructions
+
+
+def diff_image(old, new, limit):
+    """Split the new image into (offset, length, patch) commands of at most limit bytes each."""
+    differ = Differ(old)
+    commands = []
+    for page_start in range(0, len(new), PAGE_SIZE):
+        page_end = min(page_start + PAGE_SIZE, len(new))
+        offset, length, patch = page_start, 0, bytearray()
+        for out_length, instruction in differ.page_instructions(new, page_start, page_end, limit):
+            if len(patch) + len(instruction) > limit:
+                commands.append((offset, length, bytes(patch)))
+                offset, length, patch = offset + length, 0, bytearray()
+            patch.extend(instruction)
+            length += out_length
+        commands.append((offset, length, bytes(patch)))
+    return commands
+
+
+def apply_image(old, commands):
+    """Reference patch engine, mirrors ota_patch_apply."""
+    image = bytearray()
+    for start, length, patch in commands:
+        if start != len(image):
+            raise ValueError("Commands are not contiguous")
+        i = 0
+        while i < len(patch):
+            op = patch[i]
+            if op == OP_INSERT:
+                count, = struct.unpack_from("<H", patch, i + 1)
+                image.extend(patch[i + 3:i + 3 + count])
+                i += 3 + count
+                continue
+            src, count = struct.unpack_from("<IH", patch, i + 1)
+            i += 7
+            if op == OP_COPY:
+                image.extend(old[src:src + count])
+                continue
+            done = 0
+            while done < count:
+                control = patch[i]
+                i += 1
+                run = (control - RUN_UNCHANGED + 1) if control >= RUN_UNCHANGED else (control + 1)
+                for k in range(run):
+                    delta = patch[i + k] if control < RUN_UNCHANGED else 0
+                    image.append((old[src + done + k] + delta) & 0xFF)
+                if control < RUN_UNCHANGED:
+                    i += run
+                done += run
+        if len(image) != start + length:
+            raise ValueError("Command at offset %d does not patch to its length" % start)
+    return bytes(image)
+
+
+def main(argv):
+    if len(argv) < 5:
+        print("Usage: python bank_diff.py <running firmware.bin> <new firmware.bin> <target bank entry address> <output file> [io buffer size]")
+        return -1
+    address = int(argv[3], 0)
+    limit = int(argv[5], 0) if len(argv) > 5 else 512
+
+    with open(argv[1], "rb") as f:
+        old = f.read()
+    with open(argv[2], "rb") as f:
+        new = bytearray(f.read())
+    # Pad to whole words, the padding is what an erased flash reads anyway
+    if len(new) % 4 != 0:
+        new.extend(bytearray([fill_byte] * (4 - len(new) % 4)))
+
+    commands = diff_image(old, new, limit)
+    if apply_image(old, commands) != bytes(new):
+        print("Error: Round trip check failed")
+        return -1
+
+    patch_size = 0
+    with open(argv[4], "wb") as output_file:
+        for start, length, patch in commands:
+            output_file.write(struct.pack("<IIH", address + start, length, len(patch)))
+            output_file.write(patch)
+            patch_size += len(patch)
+    print(f"Patched {len(new)} bytes with {patch_size} bytes ({len(commands)} commands, "
+          f"{100 * patch_size / max(len(new), 1):.1f}%) at {argv[4]}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
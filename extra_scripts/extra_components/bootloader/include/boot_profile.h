@@ -0,0 +1,46 @@
+// boot_profile.h
+// This file contains the definitions for the boot time profile the bootloader hands over to the application.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __BOOT_PROFILE_H__
+#define __BOOT_PROFILE_H__
+
+#include "CH58x_common.h"
+
+// Keep in sync with lib/libota/include/ota_boot_profile.h
+// The profile lives in the last 64 bytes of RAM, which no linker script hands out, so it survives the jump.
+// Stamps are RTC cycles (32 kHz), the clock keeps its rate through SetSysClock.
+#define BOOT_PROFILE_ADDRESS 0x20007FC0
+#define BOOT_PROFILE_MAGIC 0x464F5250 // "PROF"
+#define BOOT_PROFILE_STAMP_NONE 0xFFFFFFFF
+
+// Features of the bootloader the application has to know about
+#define BOOT_PROFILE_FEATURE_JOURNAL 0x01 // EEPROM flags are read from the journal (see ota_journal.h)
+
+typedef enum _boot_phase_t
+{
+    BOOT_PHASE_ENTRY = 0, // Bootloader main entered
+    BOOT_PHASE_CLOCK, // System clock set up
+    BOOT_PHASE_CONSOLE, // Debug UART set up and banner printed
+    BOOT_PHASE_FLAGS, // EEPROM flags read
+    BOOT_PHASE_VERIFY, // Bank image checked
+    BOOT_PHASE_JUMP, // About to jump into the bank
+    BOOT_PHASE_APP_MAIN, // Application main entered
+    BOOT_PHASE_APP_ADVERTISING, // Application started advertising
+    BOOT_PHASE_MAX,
+} boot_phase_t;
+
+typedef struct _boot_profile_t
+{
+    uint32_t magic; // BOOT_PROFILE_MAGIC once the bootloader has jumped into a bank
+    uint32_t rtc_offset; // Added to the RTC by the application once it has restarted the RTC
+    uint32_t stamp[BOOT_PHASE_MAX]; // Stamp of each phase, BOOT_PROFILE_STAMP_NONE if not reached
+    uint8_t fast_path; // 1 if the bootloader took the fast path
+    uint8_t features; // BOOT_PROFILE_FEATURE_* of the bootloader
+    uint8_t reserved[2]; // Reserved for future use (Padding)
+} boot_profile_t;
+
+#define BOOT_PROFILE ((boot_profile_t *)BOOT_PROFILE_ADDRESS)
+
+#endif // __BOOT_PROFILE_H__
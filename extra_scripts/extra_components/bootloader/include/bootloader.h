@@ -11,6 +11,7 @@
 
 #define BOOTLOADER_FLASH_BANK_A_ENTRY 0x00001000
 #define BOOTLOADER_FLASH_BANK_B_ENTRY 0x00037000
+#define BOOTLOADER_FLASH_BANK_SIZE 0x00036000
 
 #define JUMP_FLASH_BANK_A ((void (*)(void))((int *)BOOTLOADER_FLASH_BANK_A_ENTRY))
 #define JUMP_FLASH_BANK_B ((void (*)(void))((int *)BOOTLOADER_FLASH_BANK_B_ENTRY))
@@ -0,0 +1,31 @@
+// image_manifest.h
+// This file contains the definitions for the image manifest stored at the end of each flash bank.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __IMAGE_MANIFEST_H__
+#define __IMAGE_MANIFEST_H__
+
+#include "CH58x_common.h"
+#include "bootloader.h"
+
+// Keep in sync with lib/libota/include/ota_image_manifest.h
+// The bootloader has no key, it only checks the digest, the MAC is checked by CONFIRM before switching banks
+#define BOOTLOADER_IMAGE_MANIFEST_MAGIC 0x4D41544F // "OTAM"
+#define BOOTLOADER_IMAGE_MANIFEST_SIZE 64
+#define BOOTLOADER_IMAGE_MANIFEST_OFFSET (BOOTLOADER_FLASH_BANK_SIZE - BOOTLOADER_IMAGE_MANIFEST_SIZE)
+
+typedef struct _bootloader_image_manifest_t
+{
+    uint32_t magic; // BOOTLOADER_IMAGE_MANIFEST_MAGIC
+    uint32_t version; // Firmware version, set by the build
+    uint32_t image_length; // Length of the image covered by the digest
+    uint32_t reserved; // Reserved for future use (0xFFFFFFFF)
+    uint8_t digest[32]; // SHA256 of the image
+    uint8_t mac[16]; // AES-CMAC of all fields above
+} bootloader_image_manifest_t;
+
+// Check the image of a flash bank against the digest in its manifest
+uint32_t bootloader_image_check(uint32_t entry);
+
+#endif // __IMAGE_MANIFEST_H__
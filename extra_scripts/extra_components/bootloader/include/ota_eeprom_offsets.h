@@ -15,4 +15,8 @@
 #define OTA_EEPROM_FLASH_READ_LEN (sizeof(bootloader_flash_eeprom_data_t))
 #define OTA_EEPROM_FLASH_ERASE_SIZE (EEPROM_PAGE_SIZE)
 
+// The flags are kept in an append-only journal over these EEPROM pages (see ota_journal.h)
+// Flags written by older firmware are the raw struct at OTA_EEPROM_FLASH_OFFSET_FLAGS, read once when the journal is empty
+#define OTA_EEPROM_FLASH_JOURNAL_PAGES 8
+
 #endif // __OTA_EEPROM_OFFSETS_H__
@@ -27,6 +27,7 @@ typedef enum _boot_reason_code_t
 {
     REASON_NORMAL = 0,
     REASON_FALLBACK_BOOT,
+    REASON_IMAGE_REJECTED,
     REASON_MAX = 0xff,
 } boot_reason_code_t;
 
@@ -36,6 +37,14 @@ typedef struct _bootloader_flash_eeprom_data_t
     uint8_t flash_mode_flag; // Flash mode flag
     uint8_t boot_reason_code; // Boot reason code
     uint8_t reserved[2]; // Reserved for future use (Padding)
+    uint32_t image_generation[2]; // Generation of the image in Bank A and B, bumped when libota starts to modify the bank
+    uint32_t image_verified[2]; // Generation the bootloader has verified the image of Bank A and B at
 } bootloader_flash_eeprom_data_t;
 
+// Image verdict cache, a bank image is only hashed again once its generation has changed
+// Erased EEPROM reads as OTA_IMAGE_GENERATION_NONE, which is never a verified generation
+#define OTA_IMAGE_GENERATION_NONE 0xFFFFFFFF
+#define OTA_IMAGE_GENERATION_NEXT(generation) ((generation) + 1 == OTA_IMAGE_GENERATION_NONE ? 0 : (generation) + 1)
+#define OTA_IMAGE_BANK_INDEX(bank) ((bank) == FLASH_BANK_A ? 0 : 1)
+
 #endif // __OTA_EEPROM_STRUCTS_H__
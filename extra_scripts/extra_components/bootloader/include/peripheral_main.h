@@ -9,7 +9,10 @@
 #include "CH58x_common.h"
 #include "ota_eeprom_offsets.h"
 #include "ota_eeprom_structs.h"
+#include "ota_journal.h"
 #include "bootloader.h"
+#include "image_manifest.h"
+#include "boot_profile.h"
 
 #ifdef DEBUG
 #define LOG(X...) printf("[Bootloader] "X)
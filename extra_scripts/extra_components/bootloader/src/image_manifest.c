@@ -0,0 +1,113 @@
+// image_manifest.c
+// This file contains the image check of the bootloader, a size optimized SHA256 of the bank against its manifest.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#include "image_manifest.h"
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/**
+ * @brief Hash one 64-byte block into the SHA256 state
+ * Rolled loops on purpose, the bootloader has to fit in 12K and hashes a bank only once per update.
+ *
+ * @param state SHA256 state
+ * @param block Pointer to the 64-byte block
+ */
+static void bootloader_sha256_block(uint32_t state[8], const uint8_t *block)
+{
+    uint32_t w[16];
+    uint32_t v[8];
+    uint32_t i, t1, t2, s0, s1;
+
+    for (i = 0; i < 8; i++)
+        v[i] = state[i];
+    for (i = 0; i < 64; i++)
+    {
+        if (i < 16)
+        {
+            w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+                   ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+        }
+        else
+        {
+            s0 = ROTR(w[(i + 1) & 15], 7) ^ ROTR(w[(i + 1) & 15], 18) ^ (w[(i + 1) & 15] >> 3);
+            s1 = ROTR(w[(i + 14) & 15], 17) ^ ROTR(w[(i + 14) & 15], 19) ^ (w[(i + 14) & 15] >> 10);
+            w[i & 15] += s0 + s1 + w[(i + 9) & 15];
+        }
+        t1 = v[7] + (ROTR(v[4], 6) ^ ROTR(v[4], 11) ^ ROTR(v[4], 25)) +
+             ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256_k[i] + w[i & 15];
+        t2 = (ROTR(v[0], 2) ^ ROTR(v[0], 13) ^ ROTR(v[0], 22)) +
+             ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = v[3] + t1;
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = t1 + t2;
+    }
+    for (i = 0; i < 8; i++)
+        state[i] += v[i];
+}
+
+/**
+ * @brief Check the image of a flash bank against the digest in its manifest
+ *
+ * @param entry Entry address of the flash bank
+ *
+ * @return uint32_t 1 if the manifest is present and the image matches its digest, 0 otherwise
+ */
+uint32_t bootloader_image_check(uint32_t entry)
+{
+    // Code flash is memory mapped, the bank is hashed in place
+    const bootloader_image_manifest_t *manifest = (const bootloader_image_manifest_t *)(uintptr_t)(entry + BOOTLOADER_IMAGE_MANIFEST_OFFSET);
+    const uint8_t *image = (const uint8_t *)(uintptr_t)entry;
+    uint32_t state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    __attribute__((aligned(4))) uint8_t block[64];
+    uint32_t length, offset, i;
+
+    if (manifest->magic != BOOTLOADER_IMAGE_MANIFEST_MAGIC)
+        return 0; // No manifest
+    length = manifest->image_length;
+    if (length == 0 || length > BOOTLOADER_IMAGE_MANIFEST_OFFSET)
+        return 0; // Image would overlap the manifest
+
+    for (offset = 0; length - offset >= 64; offset += 64)
+        bootloader_sha256_block(state, image + offset);
+
+    // Padding: 0x80, zeros, then the bit length big-endian in the last 8 bytes
+    memset(block, 0, sizeof(block));
+    memcpy(block, image + offset, length - offset);
+    block[length - offset] = 0x80;
+    if (length - offset >= 56)
+    {
+        bootloader_sha256_block(state, block);
+        memset(block, 0, sizeof(block));
+    }
+    for (i = 0; i < 4; i++)
+        block[63 - i] = (uint8_t)((length << 3) >> (i * 8));
+    block[59] = (uint8_t)(length >> 29);
+    bootloader_sha256_block(state, block);
+
+    for (i = 0; i < 32; i++)
+    {
+        if (manifest->digest[i] != (uint8_t)(state[i / 4] >> (24 - (i % 4) * 8)))
+            return 0;
+    }
+    return 1;
+}
@@ -12,6 +12,8 @@ boot_reason_code_t boot_reason_code;
 
 __attribute__((aligned(8))) bootloader_flash_eeprom_data_t eeprom_data;
 
+static ota_journal_t eeprom_journal = OTA_JOURNAL_INIT(OTA_EEPROM_FLASH_OFFSET_FLAGS, OTA_EEPROM_FLASH_JOURNAL_PAGES, OTA_EEPROM_FLASH_READ_LEN);
+
 __attribute__((interrupt("WCH-Interrupt-fast")))
 __attribute__((section(".highcode")))
 void HardFault_Handler( void )
@@ -66,6 +68,8 @@ char *boot_reason_code_to_string(boot_reason_code_t code)
             return "Normal";
         case REASON_FALLBACK_BOOT:
             return "Fallback Boot";
+        case REASON_IMAGE_REJECTED:
+            return "Image Rejected";
         default:
             return "Unknown";
     }
@@ -101,7 +105,9 @@ void enter_bootrom_isp(void)
 
 void bootloader_get_eeprom_flags(void)
 {
-    EEPROM_READ(OTA_EEPROM_FLASH_OFFSET_FLAGS, (uint32_t *)&eeprom_data, OTA_EEPROM_FLASH_READ_LEN);
+    // Same journal reader as libota, an empty journal still holds the flags of older firmware
+    if (!ota_journal_read(&eeprom_journal, &eeprom_data))
+        EEPROM_READ(OTA_EEPROM_FLASH_OFFSET_FLAGS, (uint32_t *)&eeprom_data, OTA_EEPROM_FLASH_READ_LEN);
     current_flash_bank = eeprom_data.current_flash_bank;
     flash_mode_flag = eeprom_data.flash_mode_flag;
     boot_reason_code = eeprom_data.boot_reason_code;
@@ -115,6 +121,111 @@ void bootloader_print_eeprom_flags(void)
     LOG(" - Boot Reason Code: %s\r\n", boot_reason_code_to_string(boot_reason_code));
 }
 
+void bootloader_profile_begin(void)
+{
+    // Nothing in the profile is valid until the jump, RAM holds garbage after a power cycle
+    uint32_t i;
+    BOOT_PROFILE->magic = 0;
+    BOOT_PROFILE->rtc_offset = 0;
+    for (i = 0; i < BOOT_PHASE_MAX; i++)
+        BOOT_PROFILE->stamp[i] = BOOT_PROFILE_STAMP_NONE;
+    BOOT_PROFILE->fast_path = 0;
+    BOOT_PROFILE->features = BOOT_PROFILE_FEATURE_JOURNAL;
+    BOOT_PROFILE->stamp[BOOT_PHASE_ENTRY] = RTC_GetCycle32k();
+}
+
+void bootloader_profile_mark(boot_phase_t phase)
+{
+    BOOT_PROFILE->stamp[phase] = RTC_GetCycle32k();
+}
+
+void bootloader_profile_finish(void)
+{
+    BOOT_PROFILE->stamp[BOOT_PHASE_JUMP] = RTC_GetCycle32k();
+    BOOT_PROFILE->magic = BOOT_PROFILE_MAGIC; // Hand the profile over to the application
+}
+
+void bootloader_save_eeprom_flags(void)
+{
+    // Append the updated flags to the journal
+    // A page is only erased once the journal wraps into it
+    ota_journal_write(&eeprom_journal, &eeprom_data);
+}
+
+uint32_t bootloader_verify_bank(current_flash_bank_t bank)
+{
+    // The bank image is only hashed once per generation, libota bumps the generation when it modifies the bank
+    uint32_t index = OTA_IMAGE_BANK_INDEX(bank);
+    uint32_t generation = eeprom_data.image_generation[index];
+
+    // The VERIFY stamp is taken once, when the check is done, on every path
+    if (generation != OTA_IMAGE_GENERATION_NONE && eeprom_data.image_verified[index] == generation)
+    {
+        bootloader_profile_mark(BOOT_PHASE_VERIFY);
+        return 1; // Verified before, normal boots stay fast
+    }
+
+    LOG("Verifying the image of Flash Bank %s...\r\n", flash_bank_to_string(bank));
+    if (!bootloader_image_check(bank == FLASH_BANK_A ? BOOTLOADER_FLASH_BANK_A_ENTRY : BOOTLOADER_FLASH_BANK_B_ENTRY))
+    {
+        bootloader_profile_mark(BOOT_PHASE_VERIFY);
+        LOG("Flash Bank %s image is corrupted or has no manifest!\r\n", flash_bank_to_string(bank));
+        return 0;
+    }
+
+    // Cache the verdict
+    if (generation == OTA_IMAGE_GENERATION_NONE)
+        generation = 0; // Never verified, e.g. EEPROM written by an older bootloader
+    eeprom_data.image_generation[index] = generation;
+    eeprom_data.image_verified[index] = generation;
+    bootloader_save_eeprom_flags();
+    bootloader_profile_mark(BOOT_PHASE_VERIFY);
+    LOG("Flash Bank %s image verified at generation %lu.\r\n", flash_bank_to_string(bank), (unsigned long)generation);
+    return 1;
+}
+
+void bootloader_fail_boot(void)
+{
+    // Boot fail, all flash banks are asserted to be bad, entering Bootrom ISP for recovery
+    eeprom_data.current_flash_bank = FLASH_BANK_FAIL_BOOT; // Set to fail boot
+    eeprom_data.flash_mode_flag = FLASH_MODE_FLAG_FIRSTBOOT; // Set to first boot
+    eeprom_data.boot_reason_code = REASON_FALLBACK_BOOT; // Set to fallback boot
+    bootloader_save_eeprom_flags();
+
+    LOG("Entering Bootrom ISP for recovery...\r\n");
+    enter_bootrom_isp();
+    // Should not return from here, if it does, something went wrong
+    LOG("Failed to enter Bootrom ISP. halting...\r\n");
+}
+
+void bootloader_jump_bank(current_flash_bank_t bank)
+{
+    LOG("Booting into Flash Bank %s...\r\n", flash_bank_to_string(bank));
+    bootloader_profile_finish();
+    if (bank == FLASH_BANK_A)
+        JUMP_FLASH_BANK_A();
+    else
+        JUMP_FLASH_BANK_B();
+}
+
+void bootloader_fallback_boot(void)
+{
+    // Fall back to the other bank, as a first boot, so a crash there ends in Bootrom ISP
+    current_flash_bank_t other = current_flash_bank == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A;
+    if (!bootloader_verify_bank(other))
+    {
+        LOG("There is no valid flash bank to boot from.\r\n");
+        bootloader_fail_boot();
+        return;
+    }
+    current_flash_bank = other;
+    eeprom_data.current_flash_bank = current_flash_bank; // Update the current flash bank
+    eeprom_data.flash_mode_flag = FLASH_MODE_FLAG_FIRSTBOOT; // Set to first boot
+    eeprom_data.boot_reason_code = REASON_FALLBACK_BOOT; // Set to fallback boot
+    bootloader_save_eeprom_flags();
+    bootloader_jump_bank(current_flash_bank);
+}
+
 void bootloader_boot(void)
 {
     // bank: FAIL_BOOT, mode: <any>, reason: <any>
@@ -133,87 +244,52 @@ void bootloader_boot(void)
         if(flash_mode_flag == FLASH_MODE_FLAG_FIRSTBOOT && 
            boot_reason_code == REASON_FALLBACK_BOOT)
         {
-            // Boot fail, all flash banks are asserted to be bad, entering Bootrom ISP for recovery
             LOG("EEPROM indicates all flash banks are bad, there is no valid flash bank to boot from.\r\n");
-            eeprom_data.current_flash_bank = FLASH_BANK_FAIL_BOOT; // Set to fail boot
-            eeprom_data.flash_mode_flag = FLASH_MODE_FLAG_FIRSTBOOT; // Set to first boot
-            eeprom_data.boot_reason_code = REASON_FALLBACK_BOOT; // Set to fallback boot
-
-            // Erase the EEPROM page
-            // 256 bytes is the size of the EEPROM page
-            EEPROM_ERASE(OTA_EEPROM_FLASH_OFFSET_FLAGS, OTA_EEPROM_FLASH_ERASE_SIZE);
-
-            // Write the updated flags to EEPROM
-            EEPROM_WRITE(OTA_EEPROM_FLASH_OFFSET_FLAGS, (uint32_t *)&eeprom_data, OTA_EEPROM_FLASH_READ_LEN);
-
-            LOG("Entering Bootrom ISP for recovery...\r\n");
-            enter_bootrom_isp();
-            // Should not return from here, if it does, something went wrong
-            LOG("Failed to enter Bootrom ISP. halting...\r\n");
+            bootloader_fail_boot();
             return;
         }
         // bank: A or B, mode: FLASH_MODE_FLAG_FIRSTBOOT, reason: <any except REASON_FALLBACK_BOOT>
         if(flash_mode_flag == FLASH_MODE_FLAG_FIRSTBOOT)
         {
             LOG("EEPROM indicates the last boot was crashed, attempting to boot into the last known good flash bank...\r\n");
-            if (current_flash_bank == FLASH_BANK_A)
-                current_flash_bank = FLASH_BANK_B; // Switch to bank B
-            else
-                current_flash_bank = FLASH_BANK_A; // Switch to bank A
-            eeprom_data.current_flash_bank = current_flash_bank; // Update the current flash bank
-            eeprom_data.flash_mode_flag = FLASH_MODE_FLAG_FIRSTBOOT; // Set to first boot
-            eeprom_data.boot_reason_code = REASON_FALLBACK_BOOT; // Set to fallback boot
-
-            // Erase the EEPROM page
-            // 256 bytes is the size of the EEPROM page
-            EEPROM_ERASE(OTA_EEPROM_FLASH_OFFSET_FLAGS, OTA_EEPROM_FLASH_ERASE_SIZE);
-
-            // Write the updated flags to EEPROM
-            EEPROM_WRITE(OTA_EEPROM_FLASH_OFFSET_FLAGS, (uint32_t *)&eeprom_data, OTA_EEPROM_FLASH_READ_LEN);
-
-            LOG("Booting into Flash Bank %s...\r\n", flash_bank_to_string(current_flash_bank));
-            if (current_flash_bank == FLASH_BANK_A)
-                JUMP_FLASH_BANK_A();
-            else
-                JUMP_FLASH_BANK_B();
+            bootloader_fallback_boot();
             return;
         }
         // bank: A or B, mode: FLASH_MODE_FLAG_FLASHED, reason: <any>
         if(flash_mode_flag == FLASH_MODE_FLAG_FLASHED)
         {
             LOG("EEPROM indicates new OTA has been performed, booting into the new flash bank...\r\n");
-            if (current_flash_bank == FLASH_BANK_A)
-                current_flash_bank = FLASH_BANK_B; // Switch to bank B
-            else
-                current_flash_bank = FLASH_BANK_A; // Switch to bank A
-            eeprom_data.current_flash_bank = current_flash_bank; // Update the current flash bank
-            eeprom_data.flash_mode_flag = FLASH_MODE_FLAG_FIRSTBOOT; // Set to first boot
-            eeprom_data.boot_reason_code = FLASH_MODE_FLAG_OK; // Set to OK boot reason
-
-            // Erase the EEPROM page
-            // 256 bytes is the size of the EEPROM page
-            EEPROM_ERASE(OTA_EEPROM_FLASH_OFFSET_FLAGS, OTA_EEPROM_FLASH_ERASE_SIZE);
-
-            // Write the updated flags to EEPROM
-            EEPROM_WRITE(OTA_EEPROM_FLASH_OFFSET_FLAGS, (uint32_t *)&eeprom_data, OTA_EEPROM_FLASH_READ_LEN);
-
-            LOG("Booting into Flash Bank %s...\r\n", flash_bank_to_string(current_flash_bank));
-            if (current_flash_bank == FLASH_BANK_A)
-                JUMP_FLASH_BANK_A();
-            else
-                JUMP_FLASH_BANK_B();
-            return;
+            current_flash_bank_t flashed = current_flash_bank == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A;
+            if (bootloader_verify_bank(flashed))
+            {
+                current_flash_bank = flashed;
+                eeprom_data.current_flash_bank = current_flash_bank; // Update the current flash bank
+                eeprom_data.flash_mode_flag = FLASH_MODE_FLAG_FIRSTBOOT; // Set to first boot
+                eeprom_data.boot_reason_code = FLASH_MODE_FLAG_OK; // Set to OK boot reason
+                bootloader_save_eeprom_flags();
+                bootloader_jump_bank(current_flash_bank);
+                return;
+            }
+
+            // Keep running the current bank, the application sees the rejection in the boot reason
+            LOG("New flash bank image is rejected, staying on Flash Bank %s.\r\n", flash_bank_to_string(current_flash_bank));
+            eeprom_data.flash_mode_flag = FLASH_MODE_FLAG_OK; // Set to OK
+            eeprom_data.boot_reason_code = REASON_IMAGE_REJECTED; // Set to image rejected
+            bootloader_save_eeprom_flags();
+            boot_reason_code = REASON_IMAGE_REJECTED;
         }
         // bank: A or B, mode: FLASH_MODE_FLAG_OK, reason: <any>
         if(boot_reason_code == REASON_FALLBACK_BOOT)
         {
             LOG("Warning: EEPROM indicates this is a fallback boot, last OTA may have failed.\r\n");
         }
-        LOG("Booting into Flash Bank %s...\r\n", flash_bank_to_string(current_flash_bank));
-        if (current_flash_bank == FLASH_BANK_A)
-            JUMP_FLASH_BANK_A();
-        else
-            JUMP_FLASH_BANK_B();
+        if (!bootloader_verify_bank(current_flash_bank))
+        {
+            // Do not wait for a crash, fall back to the other bank right away
+            bootloader_fallback_boot();
+            return;
+        }
+        bootloader_jump_bank(current_flash_bank);
         return;
     }
     // bank: <any>, mode: <any>, reason: <any>
@@ -224,26 +300,66 @@ void bootloader_boot(void)
         eeprom_data.current_flash_bank = FLASH_BANK_A; // Default to bank A
         eeprom_data.flash_mode_flag = FLASH_MODE_FLAG_FIRSTBOOT; // Set to first boot
         eeprom_data.boot_reason_code = REASON_NORMAL; // Normal boot
-
-        // Erase the EEPROM page
-        // 256 bytes is the size of the EEPROM page
-        EEPROM_ERASE(OTA_EEPROM_FLASH_OFFSET_FLAGS, OTA_EEPROM_FLASH_ERASE_SIZE);
+        eeprom_data.image_generation[0] = 0; // Both bank images are verified before their first boot
+        eeprom_data.image_generation[1] = 0;
+        eeprom_data.image_verified[0] = OTA_IMAGE_GENERATION_NONE;
+        eeprom_data.image_verified[1] = OTA_IMAGE_GENERATION_NONE;
 
         // Write the initial flags to EEPROM
-        EEPROM_WRITE(OTA_EEPROM_FLASH_OFFSET_FLAGS, (uint32_t *)&eeprom_data, OTA_EEPROM_FLASH_READ_LEN);
+        bootloader_save_eeprom_flags();
         LOG("Bootloader EEPROM initialized with default values.\r\n");
-        LOG("Now booting into Flash Bank A...\r\n");
-        JUMP_FLASH_BANK_A();
+        current_flash_bank = FLASH_BANK_A;
+        if (!bootloader_verify_bank(current_flash_bank))
+        {
+            bootloader_fallback_boot();
+            return;
+        }
+        bootloader_jump_bank(current_flash_bank);
         return;
     }
 }
 
+#if(defined(BOOTLOADER_FAST_BOOT)) && (BOOTLOADER_FAST_BOOT == TRUE)
+void bootloader_fast_boot(void)
+{
+    // Only the common case, a confirmed bank whose image has been verified before
+    // Anything else takes the normal path, including all recovery decisions
+    uint32_t index;
+    if (current_flash_bank != FLASH_BANK_A && current_flash_bank != FLASH_BANK_B)
+        return;
+    if (flash_mode_flag != FLASH_MODE_FLAG_OK)
+        return;
+    index = OTA_IMAGE_BANK_INDEX(current_flash_bank);
+    if (eeprom_data.image_generation[index] == OTA_IMAGE_GENERATION_NONE ||
+        eeprom_data.image_verified[index] != eeprom_data.image_generation[index])
+        return;
+    bootloader_profile_mark(BOOT_PHASE_VERIFY); // Same cached verdict as bootloader_verify_bank
+
+    // No clock, UART or LOG, the application sets up all of it by itself
+    BOOT_PROFILE->fast_path = 1;
+    bootloader_profile_finish();
+    if (current_flash_bank == FLASH_BANK_A)
+        JUMP_FLASH_BANK_A();
+    else
+        JUMP_FLASH_BANK_B();
+}
+#endif
+
 int main(void)
 {
+    bootloader_profile_begin();
+    // Both boot paths hand over the same power setup
     #if(defined(DCDC_ENABLE)) && (DCDC_ENABLE == TRUE)
         PWR_DCDCCfg(ENABLE);
     #endif
+    #if(defined(BOOTLOADER_FAST_BOOT)) && (BOOTLOADER_FAST_BOOT == TRUE)
+        // Flags are read once, the normal path below reuses them if the fast path does not apply
+        bootloader_get_eeprom_flags();
+        bootloader_profile_mark(BOOT_PHASE_FLAGS);
+        bootloader_fast_boot();
+    #endif
     SetSysClock(CLK_SOURCE_PLL_60MHz);
+    bootloader_profile_mark(BOOT_PHASE_CLOCK);
     #if(defined(HAL_SLEEP)) && (HAL_SLEEP == TRUE)
         GPIOA_ModeCfg(GPIO_Pin_All, GPIO_ModeIN_PU);
         GPIOB_ModeCfg(GPIO_Pin_All, GPIO_ModeIN_PU);
@@ -257,7 +373,11 @@ int main(void)
     LOG("BuildTime: " __DATE__ " " __TIME__ "\r\n");
     LOG("Author: " BOOTLOADER_AUTHOR "\r\n");
     LOG("\r\n");
-    bootloader_get_eeprom_flags();
+    bootloader_profile_mark(BOOT_PHASE_CONSOLE);
+    #if !((defined(BOOTLOADER_FAST_BOOT)) && (BOOTLOADER_FAST_BOOT == TRUE))
+        bootloader_get_eeprom_flags();
+        bootloader_profile_mark(BOOT_PHASE_FLAGS);
+    #endif
     bootloader_print_eeprom_flags();
     LOG("\r\n");
     bootloader_boot();
@@ -1,5 +1,9 @@
 Import("env")
 import os
+import sys
+
+sys.path.insert(0, os.path.join(env["PROJECT_DIR"], "extra_scripts"))
+import image_manifest
 
 buildDir = env["PROJECT_BUILD_DIR"] 
 
@@ -13,6 +17,12 @@ partitionAFirmware = os.path.join(partitionADir, "firmware.bin")
 partitionBFirmware = os.path.join(partitionBDir, "firmware.bin")
 bootloaderFirmware = os.path.join(bootloaderDir, "firmware.bin")
 
+# Image manifests written by the bank builds, placed in the last bytes of each bank
+manifests = {
+    "partitionA": os.path.join(partitionADir, "manifest.bin"),
+    "partitionB": os.path.join(partitionBDir, "manifest.bin"),
+}
+
 outputDir = os.path.join(buildDir, "mergedFirmware")
 
 layout = [
@@ -41,6 +51,14 @@ for name, firmware_path, offset, size in layout:
         exit(-1)
     with open(firmware_path, "rb") as f:
         firmware_data = f.read()
+        if name in manifests:
+            # The bootloader does not boot a bank without a valid manifest
+            if not os.path.exists(manifests[name]):
+                print(f"Error: Image manifest for {name} does not exist at {manifests[name]}")
+                exit(-1)
+            with open(manifests[name], "rb") as manifest_file:
+                firmware_data = image_manifest.place_manifest(firmware_data, manifest_file.read())
+            actual_size = len(firmware_data)
         mergedFirmware.extend(firmware_data)
         # Fill the remaining space with fill_byte
         # No need for padding for bootloader because it's the last section
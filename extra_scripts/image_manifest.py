@@ -0,0 +1,151 @@
+# image_manifest.py
+# Build side generator of the image manifest, see lib/libota/include/ota_image_manifest.h.
+# The manifest is placed in the last bytes of the bank, the bootloader checks its digest and CONFIRM checks its MAC.
+# Author: Iluna Angelic47 <admin@angelic47.com>
+# SPDX-License-Identifier: Apache-2.0
+#
+# Usage: python image_manifest.py <firmware.bin> <version> <aes128 key hex> <output manifest.bin>
+# The bank builds run this by themselves (see use_ab_bank.py) and write manifest.bin next to firmware.bin.
+# An OTA host programs firmware.bin at the bank entry and manifest.bin at bank entry + MANIFEST_OFFSET,
+# firmware_merge.py does the same for the merged image.
+
+import hashlib
+import re
+import struct
+import sys
+
+MANIFEST_MAGIC = 0x4D41544F # "OTAM"
+MANIFEST_SIZE = 64
+BANK_SIZE = 0x36000         # OTA_FLASH_BANK_SIZE
+MANIFEST_OFFSET = BANK_SIZE - MANIFEST_SIZE
+
+fill_byte = 0xFF
+
+
+def _xtime(value):
+    value <<= 1
+    return (value ^ 0x11B) if value & 0x100 else value
+
+
+def _make_sbox():
+    sbox = [0] * 256
+    p, q = 1, 1
+    while True:
+        # p runs through the multiplicative group, q through its inverses
+        p = p ^ _xtime(p)
+        q ^= q << 1
+        q ^= q << 2
+        q ^= q << 4
+        q &= 0xFF
+        if q & 0x80:
+            q ^= 0x09
+        rotl = lambda x, n: ((x << n) | (x >> (8 - n))) & 0xFF
+        sbox[p] = q ^ rotl(q, 1) ^ rotl(q, 2) ^ rotl(q, 3) ^ rotl(q, 4) ^ 0x63
+        if p == 1:
+            break
+    sbox[0] = 0x63
+    return sbox
+
+
+_SBOX = _make_sbox()
+
+
+def _expand_key(key):
+    words = [list(key[i:i + 4]) for i in range(0, 16, 4)]
+    rcon = 1
+    for i in range(4, 44):
+        word = list(words[i - 1])
+        if i % 4 == 0:
+            word = [_SBOX[b] for b in word[1:] + word[:1]]
+            word[0] ^= rcon
+            rcon = _xtime(rcon)
+        words.append([a ^ b for a, b in zip(words[i - 4], word)])
+    return [sum(words[r * 4:r * 4 + 4], []) for r in range(11)]
+
+
+def aes128_encrypt_block(round_keys, block):
+    """AES-128 encryption of one 16-byte block, only what AES-CMAC needs."""
+    state = [b ^ k for b, k in zip(block, round_keys[0])]
+    for r in range(1, 11):
+        state = [_SBOX[b] for b in state]
+        # ShiftRows, the state is column major
+        state = [state[(i + 4 * (i % 4)) % 16] for i in range(16)]
+        if r != 10:
+            mixed = []
+            for c in range(4):
+                a = state[c * 4:c * 4 + 4]
+                t = a[0] ^ a[1] ^ a[2] ^ a[3]
+                mixed.extend(a[i] ^ t ^ _xtime(a[i] ^ a[(i + 1) % 4]) for i in range(4))
+            state = mixed
+        state = [b ^ k for b, k in zip(state, round_keys[r])]
+    return bytes(state)
+
+
+def aes_cmac(key, message):
+    """AES-CMAC (RFC 4493), mirrors lib/libcryptoimpl/aes_cmac_impl.c."""
+    round_keys = _expand_key(key)
+
+    def double(block):
+        value = (int.from_bytes(block, "big") << 1) & ((1 << 128) - 1)
+        if block[0] & 0x80:
+            value ^= 0x87
+        return value.to_bytes(16, "big")
+
+    k1 = double(aes128_encrypt_block(round_keys, bytes(16)))
+    k2 = double(k1)
+    if message and len(message) % 16 == 0:
+        last = bytes(a ^ b for a, b in zip(message[-16:], k1))
+        blocks = len(message) // 16 - 1
+    else:
+        tail = message[len(message) // 16 * 16:] + b"\x80"
+        tail += bytes(16 - len(tail))
+        last = bytes(a ^ b for a, b in zip(tail, k2))
+        blocks = len(message) // 16
+    x = bytes(16)
+    for i in range(blocks):
+        x = aes128_encrypt_block(round_keys, bytes(a ^ b for a, b in zip(x, message[i * 16:(i + 1) * 16])))
+    return aes128_encrypt_block(round_keys, bytes(a ^ b for a, b in zip(x, last)))
+
+
+def parse_key(text):
+    """AES-128 key from hex, or from the OTA_GATT_AES128_KEY_BYTES initializer in the build flags."""
+    match = re.search(r"OTA_GATT_AES128_KEY_BYTES\W*\{([^}]*)\}", text)
+    if match:
+        key = bytes(int(value, 0) for value in match.group(1).split(","))
+    else:
+        key = bytes.fromhex(text)
+    if len(key) != 16:
+        raise ValueError("AES-128 key must be 16 bytes, got %d" % len(key))
+    return key
+
+
+def build_manifest(image, version, key):
+    """Manifest for an image programmed at the bank entry."""
+    if len(image) == 0 or len(image) > MANIFEST_OFFSET:
+        raise ValueError("Image of %d bytes does not fit in front of the manifest" % len(image))
+    signed = struct.pack("<IIII", MANIFEST_MAGIC, version, len(image), 0xFFFFFFFF) + hashlib.sha256(image).digest()
+    return signed + aes_cmac(key, signed)
+
+
+def place_manifest(bank, manifest):
+    """Bank sized image with the manifest in its last bytes."""
+    bank = bytearray(bank) + bytearray([fill_byte] * (BANK_SIZE - len(bank)))
+    bank[MANIFEST_OFFSET:] = manifest
+    return bytes(bank)
+
+
+def main(argv):
+    if len(argv) < 5:
+        print("Usage: python image_manifest.py <firmware.bin> <version> <aes128 key hex> <output manifest.bin>")
+        return -1
+    with open(argv[1], "rb") as f:
+        image = f.read()
+    manifest = build_manifest(image, int(argv[2], 0), parse_key(argv[3]))
+    with open(argv[4], "wb") as output_file:
+        output_file.write(manifest)
+    print(f"Manifest of {len(image)} bytes, digest {manifest[16:48].hex()} at {argv[4]}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
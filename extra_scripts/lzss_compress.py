@@ -0,0 +1,165 @@
+# lzss_compress.py
+# Host side compressor for the PROGRAM_COMPRESSED OTA command, see lib/libota/include/ota_lzss.h.
+# Splits a bank image into chunks that each fit the OTA IO buffer once compressed.
+# Author: Iluna Angelic47 <admin@angelic47.com>
+# SPDX-License-Identifier: Apache-2.0
+#
+# Usage: python lzss_compress.py <firmware.bin> <bank entry address> <output file> [io buffer size]
+# The output file is a list of records, each one PROGRAM_COMPRESSED command:
+#   address (4 bytes LE) + decompressed length (4 bytes LE) + compressed length (2 bytes LE) + compressed data
+# Chunks must be programmed in order into an erased bank, matches reach back into previously programmed chunks.
+
+import struct
+import sys
+
+WINDOW_SIZE = 4096
+MIN_MATCH = 3
+MAX_MATCH = MIN_MATCH + 15
+MAX_CHAIN = 64 # Candidates tried per position, trades compression ratio for speed
+
+fill_byte = 0xFF
+
+# Room kept at the end of a chunk for up to 3 literals (and their flag byte) to word align the output
+ALIGN_RESERVE = 4
+
+
+class _Encoder:
+    def __init__(self, limit):
+        self.limit = limit
+        self.out = bytearray()
+        self.flag_index = -1
+        self.flag_count = 8
+
+    def cost(self, is_literal):
+        return (1 if is_literal else 2) + (1 if self.flag_count == 8 else 0)
+
+    def emit(self, is_literal, payload):
+        if self.flag_count == 8:
+            self.flag_index = len(self.out)
+            self.out.append(0)
+            self.flag_count = 0
+        if is_literal:
+            self.out[self.flag_index] |= 1 << self.flag_count
+        self.flag_count += 1
+        self.out.extend(payload)
+
+
+def _find_match(image, pos, end, chains):
+    key = bytes(image[pos:pos + MIN_MATCH])
+    best_length, best_offset = 0, 0
+    if len(key) < MIN_MATCH:
+        return best_length, best_offset
+    max_length = min(MAX_MATCH, end - pos)
+    for candidate in reversed(chains.get(key, [])[-MAX_CHAIN:]):
+        offset = pos - candidate
+        if offset > WINDOW_SIZE:
+            break
+        length = 0
+        while length < max_length and image[candidate + length] == image[pos + length]:
+            length += 1
+        if length > best_length:
+            best_length, best_offset = length, offset
+            if length == max_length:
+                break
+    return best_length, best_offset
+
+
+def _insert(image, pos, chains):
+    key = bytes(image[pos:pos + MIN_MATCH])
+    if len(key) == MIN_MATCH:
+        chain = chains.setdefault(key, [])
+        chain.append(pos)
+        if len(chain) > MAX_CHAIN * 4:
+            del chain[:-MAX_CHAIN]
+
+
+def compress_image(image, limit):
+    """Split a word aligned image into (offset, length, compressed data) chunks of at most limit bytes each."""
+    chunks = []
+    chains = {}
+    pos = 0
+    while pos < len(image):
+        start = pos
+        encoder = _Encoder(limit)
+        while pos < len(image):
+            length, offset = _find_match(image, pos, len(image), chains)
+            is_literal = length < MIN_MATCH
+            if len(encoder.out) + encoder.cost(is_literal) + ALIGN_RESERVE > limit:
+                break
+            if is_literal:
+                encoder.emit(True, image[pos:pos + 1])
+                length = 1
+            else:
+                encoder.emit(False, bytes([(offset - 1) & 0xFF, (((offset - 1) >> 4) & 0xF0) | (length - MIN_MATCH)]))
+            for i in range(pos, pos + length):
+                _insert(image, i, chains)
+            pos += length
+        # Flash programming works on whole words, finish the chunk with literals
+        while (pos - start) % 4 != 0:
+            encoder.emit(True, image[pos:pos + 1])
+            _insert(image, pos, chains)
+            pos += 1
+        chunks.append((start, pos - start, bytes(encoder.out)))
+    return chunks
+
+
+def decompress_image(chunks):
+    """Reference decoder, mirrors ota_lzss_decode."""
+    image = bytearray()
+    for start, length, data in chunks:
+        if start != len(image):
+            raise ValueError("Chunks are not contiguous")
+        in_offset, flags, flag_count = 0, 0, 0
+        end = start + length
+        while len(image) < end:
+            if flag_count == 0:
+                flags, flag_count = data[in_offset], 8
+                in_offset += 1
+            is_literal = flags & 1
+            flags >>= 1
+            flag_count -= 1
+            if is_literal:
+                image.append(data[in_offset])
+                in_offset += 1
+                continue
+            offset = (data[in_offset] | ((data[in_offset + 1] & 0xF0) << 4)) + 1
+            count = (data[in_offset + 1] & 0x0F) + MIN_MATCH
+            in_offset += 2
+            for _ in range(count):
+                image.append(image[len(image) - offset])
+        if len(image) != end or in_offset != len(data):
+            raise ValueError("Chunk at offset %d does not decode to its length" % start)
+    return bytes(image)
+
+
+def main(argv):
+    if len(argv) < 4:
+        print("Usage: python lzss_compress.py <firmware.bin> <bank entry address> <output file> [io buffer size]")
+        return -1
+    address = int(argv[2], 0)
+    limit = int(argv[4], 0) if len(argv) > 4 else 512
+
+    with open(argv[1], "rb") as f:
+        image = bytearray(f.read())
+    # Pad to whole words, the padding is what an erased flash reads anyway
+    if len(image) % 4 != 0:
+        image.extend(bytearray([fill_byte] * (4 - len(image) % 4)))
+
+    chunks = compress_image(image, limit)
+    if decompress_image(chunks) != bytes(image):
+        print("Error: Round trip check failed")
+        return -1
+
+    compressed_size = 0
+    with open(argv[3], "wb") as output_file:
+        for start, length, data in chunks:
+            output_file.write(struct.pack("<IIH", address + start, length, len(data)))
+            output_file.write(data)
+            compressed_size += len(data)
+    print(f"Compressed {len(image)} bytes into {compressed_size} bytes ({len(chunks)} commands, "
+          f"{100 * compressed_size / max(len(image), 1):.1f}%) at {argv[3]}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,51 @@
+# page_manifest.py
+# Host side page manifest for the VERIFY_PAGES OTA command, see lib/libota/include/ota_cmd.h.
+# Prints what VERIFY_PAGES returns for an image programmed at the start of a bank.
+# Author: Iluna Angelic47 <admin@angelic47.com>
+# SPDX-License-Identifier: Apache-2.0
+#
+# Usage: python page_manifest.py <firmware.bin>
+
+import hashlib
+import sys
+
+PAGE_SIZE = 4096 # EEPROM_BLOCK_SIZE, the flash erase unit
+DIGEST_LEN = 8   # OTA_CMD_VERIFY_PAGES_DIGEST_LEN
+
+
+def page_manifest(image):
+    """Root digest and full page digests of an image."""
+    digests = [hashlib.sha256(image[i:i + PAGE_SIZE]).digest() for i in range(0, len(image), PAGE_SIZE)]
+    root = hashlib.sha256(b"".join(digests)).digest()
+    return root, digests
+
+
+def verify_pages_response(image):
+    """Expected IO buffer content after VERIFY_PAGES over the whole image."""
+    root, digests = page_manifest(image)
+    return root + b"".join(digest[:DIGEST_LEN] for digest in digests)
+
+
+def differing_pages(image, response):
+    """Indexes of the pages whose digest in a VERIFY_PAGES response does not match the image."""
+    expected = verify_pages_response(image)
+    return [i for i in range((len(expected) - 32) // DIGEST_LEN)
+            if response[32 + i * DIGEST_LEN:32 + (i + 1) * DIGEST_LEN] != expected[32 + i * DIGEST_LEN:32 + (i + 1) * DIGEST_LEN]]
+
+
+def main(argv):
+    if len(argv) < 2:
+        print("Usage: python page_manifest.py <firmware.bin>")
+        return -1
+    with open(argv[1], "rb") as f:
+        image = f.read()
+    root, digests = page_manifest(image)
+    print(f"length {len(image)}")
+    print(f"root {root.hex()}")
+    for i, digest in enumerate(digests):
+        print(f"page {i:2d} {digest[:DIGEST_LEN].hex()}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -1,8 +1,11 @@
 Import("env")
+import os
+import sys
 
-# redefine the upload.maximum_size to 216K => 221184 bytes
+# redefine the upload.maximum_size to 216K - 64 => 221120 bytes
+# the last 64 bytes of the bank hold the image manifest
 board = env.BoardConfig()
-board.update("upload.maximum_size", 221184)
+board.update("upload.maximum_size", 221120)
 
 # redefine the supported frameworks
 board.update("frameworks", ["noneos-sdk-autoota"])
@@ -30,3 +33,25 @@ elif bank == 'bootloader':
 # see %platform-ch32v-dir%/builder/frameworks/noneos_sdk_autoota.py
 #
 # return join(PROJECT_DIR, "extra_scripts", "ldscripts", "Link_" + board.get("build.series", "")[0:-1].upper() + "x") + "." + bank + ".ld"
+
+# write the image manifest (see image_manifest.py) next to firmware.bin after every build
+# the version comes from the custom_firmware_version option, the key from the build flags
+sys.path.insert(0, os.path.join(env["PROJECT_DIR"], "extra_scripts"))
+import image_manifest
+
+def write_image_manifest(source, target, env):
+    firmware_path = target[0].get_abspath()
+    manifest_path = os.path.join(os.path.dirname(firmware_path), "manifest.bin")
+    version = int(str(env.GetProjectOption("custom_firmware_version", "0")), 0)
+    build_flags = env.GetProjectOption("build_flags", "")
+    if not isinstance(build_flags, str):
+        build_flags = " ".join(build_flags)
+    key = image_manifest.parse_key(build_flags)
+    with open(firmware_path, "rb") as f:
+        manifest = image_manifest.build_manifest(f.read(), version, key)
+    with open(manifest_path, "wb") as f:
+        f.write(manifest)
+    print(f"Image manifest version {version} created at {manifest_path}")
+
+if bank != "bootloader":
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", write_image_manifest)
@@ -39,42 +39,65 @@ void my_generate_subkey(uint8_t *key, uint8_t *K1, uint8_t *K2) {
     }
 }
 
-void AES_CMAC(uint8_t *key, uint8_t *msg, uint32_t len, uint8_t *mac) {
-    uint8_t K1[16], K2[16];
-    my_generate_subkey(key, K1, K2);
+void aes_cmac_key_init(aes_cmac_key_t *key_ctx, const uint8_t *key) {
+    memcpy(key_ctx->key, key, 16);
+    my_generate_subkey(key_ctx->key, key_ctx->K1, key_ctx->K2);
+}
 
-    uint32_t n = (len + 15) / 16;
-    int last_block_complete = (len % 16 == 0) && (len != 0);
+void aes_cmac_init(aes_cmac_ctx_t *ctx, const aes_cmac_key_t *key_ctx) {
+    ctx->key_ctx = key_ctx;
+    memset(ctx->X, 0, 16);  // initial vector (0x00...00)
+    ctx->block_len = 0;
+}
 
-    uint8_t M_last[16] = {0};
-    uint8_t block[16] = {0};
-    uint8_t X[16] = {0};  // initial vector (0x00...00)
+void aes_cmac_update(aes_cmac_ctx_t *ctx, const uint8_t *msg, uint32_t len) {
+    uint8_t block[16];
 
-    // Prepare M_last
-    if (n == 0) {
-        n = 1;
-        memset(block, 0, 16);
-        block[0] = 0x80;
-        my_xor_128(block, K2, M_last);
-    } else {
-        if (last_block_complete) {
-            my_xor_128(&msg[16 * (n - 1)], K1, M_last);
-        } else {
-            uint32_t last_len = len % 16;
-            memset(block, 0, 16);
-            memcpy(block, &msg[16 * (n - 1)], last_len);
-            block[last_len] = 0x80;
-            my_xor_128(block, K2, M_last);
+    while (len > 0) {
+        // The buffered block is only processed once more data follows,
+        // because the last block of the message gets the subkey applied in aes_cmac_final
+        if (ctx->block_len == 16) {
+            my_xor_128(ctx->X, ctx->block, block);
+            AES_ENCRYPT((uint8_t *)ctx->key_ctx->key, block, ctx->X);
+            ctx->block_len = 0;
+        }
+
+        uint32_t take = 16 - ctx->block_len;
+        if (take > len) {
+            take = len;
         }
+        memcpy(&ctx->block[ctx->block_len], msg, take);
+        ctx->block_len += take;
+        msg += take;
+        len -= take;
     }
+}
 
-    // Process all blocks except the last
-    for (uint32_t i = 0; i < n - 1; i++) {
-        my_xor_128(X, &msg[16 * i], block);
-        AES_ENCRYPT(key, block, X);
+void aes_cmac_final(aes_cmac_ctx_t *ctx, uint8_t *mac) {
+    uint8_t M_last[16];
+    uint8_t block[16];
+
+    // Prepare M_last
+    if (ctx->block_len == 16) {
+        my_xor_128(ctx->block, (uint8_t *)ctx->key_ctx->K1, M_last);
+    } else {
+        memset(block, 0, 16);
+        memcpy(block, ctx->block, ctx->block_len);
+        block[ctx->block_len] = 0x80;
+        my_xor_128(block, (uint8_t *)ctx->key_ctx->K2, M_last);
     }
 
     // Process last block
-    my_xor_128(X, M_last, block);
-    AES_ENCRYPT(key, block, mac);
+    my_xor_128(ctx->X, M_last, block);
+    AES_ENCRYPT((uint8_t *)ctx->key_ctx->key, block, mac);
+}
+
+void AES_CMAC(uint8_t *key, uint8_t *msg, uint32_t len, uint8_t *mac) {
+    aes_cmac_key_t key_ctx;
+    aes_cmac_ctx_t ctx;
+
+    aes_cmac_key_init(&key_ctx, key);
+    aes_cmac_init(&ctx, &key_ctx);
+    aes_cmac_update(&ctx, msg, len);
+    aes_cmac_final(&ctx, mac);
 }
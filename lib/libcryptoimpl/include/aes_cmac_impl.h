@@ -14,6 +14,56 @@
 
 #include "CH58x_common.h"
 
+// Precomputed key context: the key and its CMAC subkeys K1/K2
+// Generating the subkeys costs one AES encryption, so keep this around for keys that do not change
+typedef struct {
+    __attribute__((aligned(4))) uint8_t key[16];
+    __attribute__((aligned(4))) uint8_t K1[16];
+    __attribute__((aligned(4))) uint8_t K2[16];
+} aes_cmac_key_t;
+
+// Incremental AES-CMAC context
+typedef struct {
+    const aes_cmac_key_t *key_ctx;             // Key and subkeys used for this MAC
+    __attribute__((aligned(4))) uint8_t X[16];     // Chaining value
+    __attribute__((aligned(4))) uint8_t block[16]; // Pending block, processed once more data follows
+    uint32_t block_len;                        // Number of bytes in the pending block
+} aes_cmac_ctx_t;
+
+/**
+ * @brief Precompute the CMAC subkeys for a key.
+ *
+ * @param key_ctx Pointer to the key context to be initialized.
+ * @param key Pointer to the AES key (16 bytes).
+ */
+void aes_cmac_key_init(aes_cmac_key_t *key_ctx, const uint8_t *key);
+
+/**
+ * @brief Start a new AES-CMAC computation.
+ *
+ * @param ctx Pointer to the CMAC context to be initialized.
+ * @param key_ctx Pointer to a key context prepared by aes_cmac_key_init, must stay valid until aes_cmac_final.
+ */
+void aes_cmac_init(aes_cmac_ctx_t *ctx, const aes_cmac_key_t *key_ctx);
+
+/**
+ * @brief Feed message data into the AES-CMAC computation.
+ * May be called any number of times with any lengths, e.g. as data arrives.
+ *
+ * @param ctx Pointer to the CMAC context.
+ * @param msg Pointer to the message data.
+ * @param len Length of the message data in bytes.
+ */
+void aes_cmac_update(aes_cmac_ctx_t *ctx, const uint8_t *msg, uint32_t len);
+
+/**
+ * @brief Finish the AES-CMAC computation.
+ *
+ * @param ctx Pointer to the CMAC context.
+ * @param mac Pointer to the output buffer where the computed MAC will be stored (16 bytes).
+ */
+void aes_cmac_final(aes_cmac_ctx_t *ctx, uint8_t *mac);
+
 /** 
 * @brief Functions for AES-CMAC operations
 * These functions are used to compute the AES-CMAC of a message using a given key.
@@ -24,6 +74,8 @@
 * @param msg: Pointer to the message to be authenticated.
 * @param len: Length of the message in bytes.
 * @param mac: Pointer to the output buffer where the computed MAC will be stored (16 bytes).
+*
+* Convenience one-shot variant, regenerates the subkeys on every call.
 */
 void AES_CMAC(uint8_t *key, uint8_t *msg, uint32_t len, uint8_t *mac);
 
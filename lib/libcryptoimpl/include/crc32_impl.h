@@ -0,0 +1,37 @@
+// crc32_impl.h
+// This file contains the software implementation of the CRC-32 checksum used for quick integrity checks.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __CRC32_IMPL_H__
+#define __CRC32_IMPL_H__
+
+#ifdef CH58xBLE_ROM
+#include "CH58xBLE_ROM.H"
+#else
+#include "CH58xBLE_LIB.h"
+#endif
+
+#include "CH58x_common.h"
+
+// Initial value of a running CRC-32
+#define CRC32_INIT 0xFFFFFFFF
+
+// Final value of a running CRC-32, same as zlib.crc32 / IEEE 802.3
+#define CRC32_FINAL(crc) ((crc) ^ 0xFFFFFFFF)
+
+/**
+ * @brief Update a running CRC-32 with new data.
+ * 
+ * Start with CRC32_INIT and convert the result with CRC32_FINAL once all data has been processed.
+ * The data can be fed in any number of chunks.
+ *
+ * @param crc Running CRC-32 value.
+ * @param data Pointer to the input data.
+ * @param len Length of the input data in bytes.
+ * 
+ * @return uint32_t The updated running CRC-32 value.
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t data[], size_t len);
+
+#endif // __CRC32_IMPL_H__
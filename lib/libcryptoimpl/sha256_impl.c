@@ -1,8 +1,9 @@
 #include "sha256_impl.h"
 
 #define ROTRIGHT(word, bits) (((word) >> (bits)) | ((word) << (32 - (bits))))
-#define CH(x,y,z) (((x) & (y)) ^ (~(x) & (z)))
-#define MAJ(x,y,z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+// Same functions as in FIPS 180-4 with one operation less each
+#define CH(x,y,z) ((((y) ^ (z)) & (x)) ^ (z))
+#define MAJ(x,y,z) (((x) & (y)) | (((x) | (y)) & (z)))
 #define EP0(x) (ROTRIGHT(x,2) ^ ROTRIGHT(x,13) ^ ROTRIGHT(x,22))
 #define EP1(x) (ROTRIGHT(x,6) ^ ROTRIGHT(x,11) ^ ROTRIGHT(x,25))
 #define SIG0(x) (ROTRIGHT(x,7) ^ ROTRIGHT(x,18) ^ ((x) >> 3))
@@ -27,16 +28,46 @@ static const uint32_t k[64] = {
     0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 
 };
 
+// Big-endian word load, aligned input takes a single word load and a byte swap
+#define LOAD_BE32(p) (__builtin_bswap32(*(const uint32_t *)(p)))
+#define LOAD_BE32_UNALIGNED(p) (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+// Message schedule over a rolling window of 16 words instead of 64
+#define SCHEDULE(i) (m[(i) & 15] += SIG1(m[((i) - 2) & 15]) + m[((i) - 7) & 15] + SIG0(m[((i) - 15) & 15]))
+
+// One round, the working variables are renamed by the caller instead of shifted
+#define ROUND(a, b, c, d, e, f, g, h, i, w) do { \
+    uint32_t t1 = (h) + EP1(e) + CH(e, f, g) + k[i] + (w); \
+    (d) += t1; \
+    (h) = t1 + EP0(a) + MAJ(a, b, c); \
+} while (0)
+
+#define ROUNDS_8(i, W) do { \
+    ROUND(a, b, c, d, e, f, g, h, (i) + 0, W((i) + 0)); \
+    ROUND(h, a, b, c, d, e, f, g, (i) + 1, W((i) + 1)); \
+    ROUND(g, h, a, b, c, d, e, f, (i) + 2, W((i) + 2)); \
+    ROUND(f, g, h, a, b, c, d, e, (i) + 3, W((i) + 3)); \
+    ROUND(e, f, g, h, a, b, c, d, (i) + 4, W((i) + 4)); \
+    ROUND(d, e, f, g, h, a, b, c, (i) + 5, W((i) + 5)); \
+    ROUND(c, d, e, f, g, h, a, b, (i) + 6, W((i) + 6)); \
+    ROUND(b, c, d, e, f, g, h, a, (i) + 7, W((i) + 7)); \
+} while (0)
+
+#define W_INPUT(i) (m[i])
+#define W_SCHEDULE(i) (SCHEDULE(i))
+
 void sha256_transform(SHA256_CTX * ctx,
     const uint8_t data[]) {
-    uint32_t a, b, c, d, e, f, g, h, t1, t2, m[64];
+    uint32_t a, b, c, d, e, f, g, h, m[16];
     int i;
 
-    for (i = 0; i < 16; ++i)
-        m[i] = (data[i * 4] << 24) | (data[i * 4 + 1] << 16) |
-        (data[i * 4 + 2] << 8) | (data[i * 4 + 3]);
-    for (; i < 64; ++i)
-        m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
+    if (((uintptr_t)data & 0x03) == 0) {
+        for (i = 0; i < 16; ++i)
+            m[i] = LOAD_BE32(data + i * 4);
+    } else {
+        for (i = 0; i < 16; ++i)
+            m[i] = LOAD_BE32_UNALIGNED(data + i * 4);
+    }
 
     a = ctx -> state[0];
     b = ctx -> state[1];
@@ -47,18 +78,10 @@ void sha256_transform(SHA256_CTX * ctx,
     g = ctx -> state[6];
     h = ctx -> state[7];
 
-    for (i = 0; i < 64; ++i) {
-        t1 = h + EP1(e) + CH(e, f, g) + k[i] + m[i];
-        t2 = EP0(a) + MAJ(a, b, c);
-        h = g;
-        g = f;
-        f = e;
-        e = d + t1;
-        d = c;
-        c = b;
-        b = a;
-        a = t1 + t2;
-    }
+    ROUNDS_8(0, W_INPUT);
+    ROUNDS_8(8, W_INPUT);
+    for (i = 16; i < 64; i += 8)
+        ROUNDS_8(i, W_SCHEDULE);
 
     ctx -> state[0] += a;
     ctx -> state[1] += b;
@@ -85,15 +108,35 @@ void sha256_init(SHA256_CTX * ctx) {
 
 void sha256_update(SHA256_CTX * ctx,
     const uint8_t data[], size_t len) {
-    for (uint32_t i = 0; i < len; ++i) {
-        ctx -> data[ctx -> datalen] = data[i];
-        ctx -> datalen++;
-        if (ctx -> datalen == 64) {
-            sha256_transform(ctx, ctx -> data);
-            ctx -> bitlen += 512;
-            ctx -> datalen = 0;
-        }
+    size_t take;
+
+    // Complete a block left over from the previous call
+    if (ctx -> datalen != 0) {
+        take = 64 - ctx -> datalen;
+        if (take > len)
+            take = len;
+        memcpy(ctx -> data + ctx -> datalen, data, take);
+        ctx -> datalen += take;
+        data += take;
+        len -= take;
+        if (ctx -> datalen < 64)
+            return;
+        sha256_transform(ctx, ctx -> data);
+        ctx -> bitlen += 512;
+        ctx -> datalen = 0;
     }
+
+    // Whole blocks are hashed straight from the caller's buffer
+    while (len >= 64) {
+        sha256_transform(ctx, data);
+        ctx -> bitlen += 512;
+        data += 64;
+        len -= 64;
+    }
+
+    // Keep the tail for the next call
+    memcpy(ctx -> data, data, len);
+    ctx -> datalen = len;
 }
 
 void sha256_final(SHA256_CTX * ctx, uint8_t hash[]) {
@@ -6,6 +6,8 @@
 #include "libota.h"
 #include "ota_eeprom_offsets.h"
 #include "ota_eeprom_structs.h"
+#include "ota_journal.h"
+#include "ota_boot_profile.h"
 
 current_flash_bank_t current_flash_bank;
 flash_mode_flag_t flash_mode_flag;
@@ -14,6 +16,8 @@ uint32_t eeprom_already_read = 0;
 
 __attribute__((aligned(8))) bootloader_flash_eeprom_data_t eeprom_data;
 
+static ota_journal_t eeprom_journal = OTA_JOURNAL_INIT(OTA_EEPROM_FLASH_OFFSET_FLAGS, OTA_EEPROM_FLASH_JOURNAL_PAGES, OTA_EEPROM_FLASH_READ_LEN);
+
 const char *ota_flash_bank_to_string(current_flash_bank_t bank)
 {
     switch (bank)
@@ -52,6 +56,8 @@ const char *ota_boot_reason_code_to_string(boot_reason_code_t code)
             return "Normal";
         case REASON_FALLBACK_BOOT:
             return "Fallback Boot (Failed to Boot from Previous Bank)";
+        case REASON_IMAGE_REJECTED:
+            return "Image Rejected (New Bank Failed Image Verification)";
         default:
             return "Unknown";
     }
@@ -59,7 +65,9 @@ const char *ota_boot_reason_code_to_string(boot_reason_code_t code)
 
 void ota_get_eeprom_flags(void)
 {
-    EEPROM_READ(OTA_EEPROM_FLASH_OFFSET_FLAGS, (uint32_t *)&eeprom_data, OTA_EEPROM_FLASH_READ_LEN);
+    // Newest journal record wins, an empty journal still holds the flags of older firmware
+    if (!ota_journal_read(&eeprom_journal, &eeprom_data))
+        EEPROM_READ(OTA_EEPROM_FLASH_OFFSET_FLAGS, (uint32_t *)&eeprom_data, OTA_EEPROM_FLASH_READ_LEN);
     current_flash_bank = eeprom_data.current_flash_bank;
     flash_mode_flag = eeprom_data.flash_mode_flag;
     boot_reason_code = eeprom_data.boot_reason_code;
@@ -141,6 +149,8 @@ const char *ota_get_flags_boot_reason_code_string(void)
 
 void ota_save_eeprom_flags(void)
 {
+    const ota_boot_profile_t *profile = ota_boot_profile_get();
+
     if (!eeprom_already_read)
         ota_get_eeprom_flags();
     
@@ -149,6 +159,16 @@ void ota_save_eeprom_flags(void)
     eeprom_data.flash_mode_flag = flash_mode_flag;
     eeprom_data.boot_reason_code = boot_reason_code;
     
+    if (profile != NULL && (profile->features & OTA_BOOT_PROFILE_FEATURE_JOURNAL))
+    {
+        // Append the updated flags to the journal
+        // A page is only erased once the journal wraps into it
+        ota_journal_write(&eeprom_journal, &eeprom_data);
+        return;
+    }
+
+    // An older bootloader only reads the raw struct at the start of the flags page
+    // The journal stays empty, so the struct is also what ota_get_eeprom_flags falls back to
     // Erase the EEPROM page
     // 256 bytes is the size of the EEPROM page
     EEPROM_ERASE(OTA_EEPROM_FLASH_OFFSET_FLAGS, OTA_EEPROM_FLASH_ERASE_SIZE);
@@ -170,3 +190,19 @@ void ota_assert_boot_ok(void)
     flash_mode_flag = FLASH_MODE_FLAG_OK; // Set to OK
     ota_save_eeprom_flags(); // Save the updated flags to EEPROM
 }
+
+void ota_invalidate_image_verdict(void)
+{
+    // libota only ever modifies the flash bank that is not currently active
+    // Bump its generation once, so the bootloader hashes the new image before booting it
+    uint32_t index;
+    if (!eeprom_already_read)
+        ota_get_eeprom_flags();
+
+    index = OTA_IMAGE_BANK_INDEX(current_flash_bank == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A);
+    if (eeprom_data.image_verified[index] != eeprom_data.image_generation[index])
+        return; // No verdict for the current generation, nothing to drop
+
+    eeprom_data.image_generation[index] = OTA_IMAGE_GENERATION_NEXT(eeprom_data.image_generation[index]);
+    ota_save_eeprom_flags(); // Save the new generation to EEPROM
+}
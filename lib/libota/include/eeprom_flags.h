@@ -26,5 +26,6 @@ const char *ota_get_flags_flash_mode_flag_string(void);
 const char *ota_get_flags_boot_reason_code_string(void);
 void ota_save_eeprom_flags(void);
 void ota_assert_boot_ok(void);
+void ota_invalidate_image_verdict(void);
 
 #endif // __EEPROM_FLAGS_H__
@@ -11,5 +11,7 @@
 #include "ota_eeprom_structs.h"
 #include "eeprom_flags.h"
 #include "ota_gatt_profile.h"
+#include "ota_boot_profile.h"
+#include "ota_link.h"
 
 #endif // __LIBOTA_H__
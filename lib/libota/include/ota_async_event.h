@@ -11,6 +11,27 @@
 #define OTA_ASYNC_EVENT_ERASE 0x0001 // Event for asynchronous erase operation
 #define OTA_ASYNC_EVENT_VERIFY 0x0002 // Event for asynchronous verify operation
 #define OTA_ASYNC_EVENT_REBOOT 0x0004 // Event for asynchronous reboot operation
+#define OTA_ASYNC_EVENT_BATCH 0x0008 // Event for asynchronous batch execution
+#define OTA_ASYNC_EVENT_PROGRAM 0x0010 // Event for asynchronous program operation
+#define OTA_ASYNC_EVENT_PROGRAM_COMPRESSED 0x0020 // Event for asynchronous compressed program operation
+#define OTA_ASYNC_EVENT_PROGRAM_PATCH 0x0040 // Event for asynchronous patch program operation
+#define OTA_ASYNC_EVENT_VERIFY_PAGES 0x0080 // Event for asynchronous per-page verify operation
+#define OTA_ASYNC_EVENT_VERIFY_CRC 0x0100 // Event for asynchronous CRC verify operation
+
+// Bytes programmed per TMOS pass, keeps the BLE stack serviced between flash writes
+#define OTA_ASYNC_PROGRAM_SLICE_SIZE 64
+
+// Verify hashes the mapped flash in steps of this size
+#define OTA_ASYNC_VERIFY_STEP_SIZE 256
+
+// CRC verify checks the mapped flash in steps of this size, CRC-32 is much cheaper than SHA256
+#define OTA_ASYNC_VERIFY_CRC_STEP_SIZE 1024
+
+// Time budget of one TMOS pass for erase and verify, in RTC cycles (32 kHz)
+// A pass runs further steps as long as the measured step cost still fits the budget
+#ifndef OTA_ASYNC_TIME_BUDGET
+#define OTA_ASYNC_TIME_BUDGET 33 // About 1 ms
+#endif
 
 // The main routine to process OTA events
 uint16_t ota_process_event(uint8_t task_id, uint16_t events);
@@ -21,15 +42,56 @@ uint32_t ota_is_busy_flag(void);
 // Function to get the status of the last asynchronous OTA event
 bStatus_t ota_get_async_event_status(void);
 
+// Function to change the time budget of one TMOS pass, in RTC cycles (32 kHz)
+void ota_async_event_set_time_budget(uint32_t budget);
+
+// Function to get the buffer a standalone program operation reads from
+// NULL if the engine is idle or busy with anything else
+const uint8_t *ota_async_event_program_buffer(void);
+
 // Function to start an asynchronous erase operation
+// Blocks that are blank already are not erased, see ota_async_event_erase_skipped
 bStatus_t ota_start_async_erase(uint32_t address, uint32_t length);
 
+// Function to get the number of blocks the last erase skipped because they were blank already
+uint32_t ota_async_event_erase_skipped(void);
+
+// Function to get the result the last verify operation wrote to its buffer, NULL for other operations
+const uint8_t *ota_async_event_result(uint32_t *length);
+
+// Function to start an asynchronous program operation
+// The data buffer must stay untouched until the operation completes
+bStatus_t ota_start_async_program(uint32_t address, const uint8_t *data, uint32_t length);
+
+// Function to start an asynchronous compressed program operation
+// The compressed data must have been checked by ota_lzss_check and stay untouched until the operation completes
+bStatus_t ota_start_async_program_compressed(uint32_t address, uint32_t length, const uint8_t *data, uint32_t data_length);
+
+// Function to start an asynchronous patch program operation
+// The patch must have been checked by ota_patch_check and stay untouched until the operation completes
+bStatus_t ota_start_async_program_patch(uint32_t address, uint32_t length, const uint8_t *patch, uint32_t patch_length, uint32_t source_entry);
+
 // Function to start an asynchronous verify operation
 bStatus_t ota_start_async_verify(uint32_t address, uint32_t length, uint8_t *buffer, uint32_t *buffer_length);
 
+// Function to start an asynchronous per-page verify operation, address must be page aligned
+bStatus_t ota_start_async_verify_pages(uint32_t address, uint32_t length, uint8_t *buffer, uint32_t *buffer_length);
+
+// Function to start an asynchronous CRC verify operation
+bStatus_t ota_start_async_verify_crc(uint32_t address, uint32_t length, uint8_t *buffer, uint32_t *buffer_length);
+
+// Function to get the CRC-32 of the data programmed since the last erase or stream begin, read back from flash
+uint32_t ota_async_event_program_crc(void);
+
+// Function to restart the CRC-32 of programmed data
+void ota_async_event_reset_program_crc(void);
+
 // Function to reboot the device after OTA operations
 bStatus_t ota_start_async_reboot(void);
 
+// Function to start executing a batch of sub-commands
+bStatus_t ota_start_async_batch(void);
+
 // Function to initialize the OTA asynchronous event system
 bStatus_t ota_async_event_init(void);
 
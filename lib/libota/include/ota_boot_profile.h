@@ -0,0 +1,57 @@
+// ota_boot_profile.h
+// This file contains the definitions and function prototypes for the boot time profile handed over by the bootloader.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __OTA_BOOT_PROFILE_H__
+#define __OTA_BOOT_PROFILE_H__
+
+#include "ota_common.h"
+
+// Keep in sync with extra_scripts/extra_components/bootloader/include/boot_profile.h
+// The profile lives in the last 64 bytes of RAM, which no linker script hands out, so it survives the jump.
+// Stamps are RTC cycles (32 kHz) on the timeline of the bootloader entry.
+#define OTA_BOOT_PROFILE_ADDRESS 0x20007FC0
+#define OTA_BOOT_PROFILE_MAGIC 0x464F5250 // "PROF"
+#define OTA_BOOT_PROFILE_STAMP_NONE 0xFFFFFFFF
+
+// Features of the bootloader the application has to know about
+// The bootloader cannot be updated over the air, so an older one may still run under newer firmware
+#define OTA_BOOT_PROFILE_FEATURE_JOURNAL 0x01 // EEPROM flags are read from the journal (see ota_journal.h)
+
+typedef enum _ota_boot_phase_t
+{
+    OTA_BOOT_PHASE_ENTRY = 0, // Bootloader main entered
+    OTA_BOOT_PHASE_CLOCK, // System clock set up
+    OTA_BOOT_PHASE_CONSOLE, // Debug UART set up and banner printed
+    OTA_BOOT_PHASE_FLAGS, // EEPROM flags read
+    OTA_BOOT_PHASE_VERIFY, // Bank image checked
+    OTA_BOOT_PHASE_JUMP, // About to jump into the bank
+    OTA_BOOT_PHASE_APP_MAIN, // Application main entered
+    OTA_BOOT_PHASE_APP_ADVERTISING, // Application started advertising
+    OTA_BOOT_PHASE_MAX,
+} ota_boot_phase_t;
+
+typedef struct _ota_boot_profile_t
+{
+    uint32_t magic; // OTA_BOOT_PROFILE_MAGIC once the bootloader has jumped into a bank
+    uint32_t rtc_offset; // Added to the RTC once the application has restarted the RTC
+    uint32_t stamp[OTA_BOOT_PHASE_MAX]; // Stamp of each phase, OTA_BOOT_PROFILE_STAMP_NONE if not reached
+    uint8_t fast_path; // 1 if the bootloader took the fast path
+    uint8_t features; // OTA_BOOT_PROFILE_FEATURE_* of the bootloader
+    uint8_t reserved[2]; // Reserved for future use (Padding)
+} ota_boot_profile_t;
+
+// Get the boot profile, NULL if the bootloader did not hand one over
+const ota_boot_profile_t *ota_boot_profile_get(void);
+
+// Record the stamp of an application phase
+void ota_boot_profile_mark(ota_boot_phase_t phase);
+
+// Keep the timeline going across an RTC restart, call right before HAL_Init
+void ota_boot_profile_rtc_restart(void);
+
+// Print the time spent in each phase
+void ota_boot_profile_print(void);
+
+#endif // __OTA_BOOT_PROFILE_H__
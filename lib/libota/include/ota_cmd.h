@@ -14,6 +14,18 @@ typedef enum _ota_cmd_opcode_t{
     OTA_CMD_OPCODE_VERIFY,
     OTA_CMD_OPCODE_REBOOT,
     OTA_CMD_OPCODE_CONFIRM,
+    OTA_CMD_OPCODE_STREAM_BEGIN,
+    OTA_CMD_OPCODE_STREAM_END,
+    OTA_CMD_OPCODE_BATCH,
+    OTA_CMD_OPCODE_SESSION_BEGIN,
+    OTA_CMD_OPCODE_PROGRAM_COMPRESSED,
+    OTA_CMD_OPCODE_PATCH,
+    OTA_CMD_OPCODE_PROGRESS,
+    OTA_CMD_OPCODE_PROGRESS_VERIFIED,
+    OTA_CMD_OPCODE_VERIFY_PAGES,
+    OTA_CMD_OPCODE_VERIFY_CRC,
+    OTA_CMD_OPCODE_DIGEST_BEGIN,
+    OTA_CMD_OPCODE_DIGEST_STATUS,
     OTA_CMD_OPCODE_MAX // This is used to determine the number of commands
 } ota_cmd_opcode_t;
 
@@ -31,6 +43,20 @@ typedef struct _ota_cmd_args_program_t {
     uint8_t *data;    // Pointer to data buffer
 } ota_cmd_args_program_t;
 
+typedef struct _ota_cmd_args_program_compressed_t {
+    uint32_t address;     // Address to program
+    uint32_t length;      // Length of the decompressed data to program
+    uint8_t *data;        // Pointer to the compressed data buffer
+    uint32_t data_length; // Length of the compressed data
+} ota_cmd_args_program_compressed_t;
+
+typedef struct _ota_cmd_args_patch_t {
+    uint32_t address;      // Address to program
+    uint32_t length;       // Length of the patched data to program
+    uint8_t *patch;        // Pointer to the patch instruction buffer
+    uint32_t patch_length; // Length of the patch instructions
+} ota_cmd_args_patch_t;
+
 typedef struct _ota_cmd_args_erase_t {
     uint32_t address; // Address to erase
     uint32_t length;  // Length of data to erase
@@ -43,6 +69,21 @@ typedef struct _ota_cmd_args_verify_t {
     uint32_t *result_length; // Length of the result buffer
 } ota_cmd_args_verify_t;
 
+typedef struct _ota_cmd_args_stream_t {
+    uint32_t address; // Address where the stream starts
+    uint32_t length;  // Total length of data to be streamed
+} ota_cmd_args_stream_t;
+
+// Batch sub-command entry header, the IO buffer of a BATCH command holds a packed list of these
+// Every entry starts on a 4-byte boundary, PROGRAM entries are followed by data_length bytes of data
+typedef struct _ota_cmd_batch_entry_t {
+    uint8_t opcode;       // Sub-command opcode (ERASE, PROGRAM or VERIFY)
+    uint8_t reserved;     // Reserved, must be zero
+    uint16_t data_length; // Length of the inline data following this header (PROGRAM only, multiple of 4)
+    uint32_t address;     // Address argument of the sub-command
+    uint32_t length;      // Length argument of the sub-command (ERASE and VERIFY only)
+} ota_cmd_batch_entry_t;
+
 // OTA command arguments length for each command
 
 // Read command: address (4 bytes) + length (4 bytes)
@@ -51,9 +92,12 @@ typedef struct _ota_cmd_args_verify_t {
 
 // Program command: address (4 bytes)
 // length and data are from the IO buffer, so they are not included in the length
+// Address and IO buffer length must be multiples of 4, flash is compared and programmed word by word
 #define OTA_CMD_ARGS_PROGRAM_LEN (sizeof(uint32_t))
 
 // Erase command: address (4 bytes) + length (4 bytes)
+// Flash blocks that are blank already are not erased again, the number of skipped blocks
+// is carried in the completion notification (4 bytes, little-endian)
 #define OTA_CMD_ARGS_ERASE_LEN (sizeof(uint32_t) + sizeof(uint32_t))
 
 // Verify command: address (4 bytes) + length (4 bytes)
@@ -64,9 +108,91 @@ typedef struct _ota_cmd_args_verify_t {
 #define OTA_CMD_ARGS_REBOOT_LEN 0
 
 // Confirm command: no arguments
+// The image manifest at the end of the inactive bank must carry a valid MAC and a version no older than
+// the running image (see ota_image_manifest.h), otherwise the command fails with OTA_STATUS_MANIFEST_INVALID
+// and the banks are not switched.
 #define OTA_CMD_ARGS_CONFIRM_LEN 0
 
-#define OTA_CMD_ARGS_MAX_LEN (OTA_CMD_ARGS_VERIFY_LEN + sizeof(uint8_t)) // +1 for the opcode
+// Stream begin command: address (4 bytes) + length (4 bytes)
+// Stream data is taken from the IO buffer writes after the stream is opened
+#define OTA_CMD_ARGS_STREAM_BEGIN_LEN (sizeof(uint32_t) + sizeof(uint32_t))
+
+// Stream end command: expected CRC-32 (4 bytes, little-endian, zlib.crc32) of the streamed data
+// Stream writes carry no token, the expected CRC in the authenticated STREAM_END covers them instead.
+// It is checked against the CRC-32 of the data programmed since STREAM_BEGIN, read back from flash,
+// so data injected into the open stream or lost on the way fails with OTA_STATUS_CRC_MISMATCH.
+#define OTA_CMD_ARGS_STREAM_END_LEN (sizeof(uint32_t))
+
+// Batch command: no arguments
+// The sub-command list is from the IO buffer, so it is not included in the length
+#define OTA_CMD_ARGS_BATCH_LEN 0
+
+// Session begin command: host nonce (16 bytes)
+#define OTA_CMD_ARGS_SESSION_BEGIN_LEN 16
+
+// Program compressed command: address (4 bytes) + decompressed length (4 bytes)
+// Compressed data is from the IO buffer, so it is not included in the length
+#define OTA_CMD_ARGS_PROGRAM_COMPRESSED_LEN (sizeof(uint32_t) + sizeof(uint32_t))
+
+// Patch command: address (4 bytes) + patched length (4 bytes)
+// Patch instructions are from the IO buffer, so they are not included in the length
+#define OTA_CMD_ARGS_PATCH_LEN (sizeof(uint32_t) + sizeof(uint32_t))
+
+// Progress command: no arguments
+// The progress map (ota_progress_map_t) of the inactive bank is returned in the IO buffer
+#define OTA_CMD_ARGS_PROGRESS_LEN 0
+
+// Progress verified command: address (4 bytes) + length (4 bytes)
+// Sent by the host after checking a VERIFY result, marks the complete pages in the range verified
+#define OTA_CMD_ARGS_PROGRESS_VERIFIED_LEN (sizeof(uint32_t) + sizeof(uint32_t))
+
+// Verify pages command: address (4 bytes, page aligned) + length (4 bytes)
+// The IO buffer returns the root digest followed by the truncated digest of every page:
+//   root = SHA256(SHA256(page 0) || SHA256(page 1) || ...), page digest = SHA256(page n)[0..7]
+// The last page may be shorter than a full page.
+#define OTA_CMD_ARGS_VERIFY_PAGES_LEN (sizeof(uint32_t) + sizeof(uint32_t))
+#define OTA_CMD_VERIFY_PAGES_PAGE_SIZE EEPROM_BLOCK_SIZE
+#define OTA_CMD_VERIFY_PAGES_ROOT_LEN 32
+#define OTA_CMD_VERIFY_PAGES_DIGEST_LEN 8
+
+// Verify CRC command: address (4 bytes) + length (4 bytes)
+// The CRC-32 (zlib.crc32) of the range is returned in the IO buffer (4 bytes, little-endian)
+#define OTA_CMD_ARGS_VERIFY_CRC_LEN (sizeof(uint32_t) + sizeof(uint32_t))
+
+// Digest begin command: address (4 bytes) + length (4 bytes)
+// Starts a running SHA256 over the range, fed by PROGRAM, PROGRAM_COMPRESSED, PATCH and stream writes
+// as long as they program the range front to back. The IO buffer is empty, or holds the expected
+// 32-byte digest, covered by the token. The program operation that completes the range fails with
+// OTA_STATUS_DIGEST_MISMATCH if the digest does not match, otherwise the range is marked verified
+// in the progress map and no separate VERIFY pass is needed.
+#define OTA_CMD_ARGS_DIGEST_BEGIN_LEN (sizeof(uint32_t) + sizeof(uint32_t))
+#define OTA_CMD_DIGEST_LEN 32
+
+// Digest status command: no arguments
+// The IO buffer returns the state (1 byte, ota_digest_state_t) followed by the digest (32 bytes),
+// which is all zero until the range has been programmed.
+#define OTA_CMD_ARGS_DIGEST_STATUS_LEN 0
+#define OTA_CMD_DIGEST_STATUS_LEN (sizeof(uint8_t) + OTA_CMD_DIGEST_LEN)
+
+// Application status codes, above the ATT error codes
+#define OTA_STATUS_DIGEST_MISMATCH 0x81 // Programmed range does not match the expected digest
+#define OTA_STATUS_MANIFEST_INVALID 0x82 // Image manifest of the bank is missing, its MAC does not match or its version is older
+#define OTA_STATUS_ERASE_REQUIRED 0x83 // Programming would need bits to go from 0 to 1, the range has not been erased
+#define OTA_STATUS_CRC_MISMATCH 0x84 // Streamed data does not match the expected CRC-32
+
+#define OTA_CMD_ARGS_MAX_LEN (OTA_CMD_ARGS_SESSION_BEGIN_LEN + sizeof(uint8_t)) // +1 for the opcode
+
+// Session authenticated commands
+// After SESSION_BEGIN, a command may set OTA_CMD_SESSION_FLAG in its opcode byte and append
+// a little-endian counter (4 bytes) and a truncated AES-CMAC tag (8 bytes) made with the session key:
+//   tag = AES-CMAC(session_key, counter || command || AES-CMAC(session_key, io_buffer))[0..7]
+// The counter must increase with every command, so no challenge read is needed.
+// The session key is AES-CMAC(ota_aes128_key, challenge || host_nonce) at SESSION_BEGIN time.
+// Note: a session authenticated ERASE or VERIFY is 21 bytes long and needs an ATT MTU of at least 24.
+#define OTA_CMD_SESSION_FLAG 0x80
+#define OTA_CMD_SESSION_COUNTER_LEN (sizeof(uint32_t))
+#define OTA_CMD_SESSION_TAG_LEN 8
+#define OTA_CMD_SESSION_TRAILER_LEN (OTA_CMD_SESSION_COUNTER_LEN + OTA_CMD_SESSION_TAG_LEN)
 
 // Table for OTA command argument lengths
 extern const uint8_t ota_cmd_args_length_table[];
@@ -88,4 +214,27 @@ bStatus_t ota_cmd_handler(
     uint32_t token_length
 );
 
+// Streaming program session
+// Once a stream is opened by an authenticated STREAM_BEGIN command, every write to the IO buffer
+// is programmed at the stream cursor, which advances by itself until STREAM_END closes the stream.
+// Only STREAM_BEGIN and STREAM_END are authenticated, STREAM_END checks the CRC-32 of the streamed data.
+// While a chunk is programmed, one more chunk can be queued in the other IO buffer.
+uint32_t ota_cmd_is_streaming(void);
+uint32_t ota_cmd_get_stream_cursor(void);
+uint32_t ota_cmd_get_stream_remaining(void);
+bStatus_t ota_cmd_stream_write(const uint8_t *data, uint32_t length);
+const uint8_t *ota_cmd_stream_pending_buffer(void);
+void ota_cmd_stream_abort(void);
+
+// Called by the asynchronous event task when an operation completes and no batch continues
+void ota_cmd_async_complete(bStatus_t status);
+
+// Drop the session key, e.g. when the connection drops
+void ota_cmd_session_end(void);
+
+// Batch execution, driven by the asynchronous event task
+uint32_t ota_cmd_batch_has_next(void);
+bStatus_t ota_cmd_batch_step(void);
+uint8_t ota_cmd_get_batch_index(void);
+
 #endif
@@ -0,0 +1,36 @@
+// ota_digest.h
+// This file contains the definitions and function prototypes for the running digest of sequentially programmed data.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __OTA_DIGEST_H__
+#define __OTA_DIGEST_H__
+
+#include "ota_common.h"
+
+// Running digest states
+typedef enum _ota_digest_state_t {
+    OTA_DIGEST_STATE_IDLE = 0, // No running digest
+    OTA_DIGEST_STATE_RUNNING,  // Waiting for the rest of the range to be programmed
+    OTA_DIGEST_STATE_DONE,     // Range programmed, no expected digest to compare with
+    OTA_DIGEST_STATE_MATCH,    // Range programmed and matches the expected digest
+    OTA_DIGEST_STATE_MISMATCH, // Range programmed but does not match the expected digest
+    OTA_DIGEST_STATE_BROKEN,   // Range was not programmed front to back, use VERIFY instead
+} ota_digest_state_t;
+
+// Start a running digest over a range, expected may be NULL
+void ota_digest_begin(uint32_t address, uint32_t length, const uint8_t *expected);
+
+// Add programmed data read back from flash, returns an error if it completes the range with a mismatch
+bStatus_t ota_digest_update(uint32_t address, uint32_t length);
+
+// Drop the digest if an erase hits data that has already been hashed
+void ota_digest_erased(uint32_t address, uint32_t length);
+
+// Get the state of the running digest
+ota_digest_state_t ota_digest_get_state(void);
+
+// Get the digest of the range, valid once the range is programmed
+const uint8_t *ota_digest_get_result(void);
+
+#endif // __OTA_DIGEST_H__
@@ -15,4 +15,13 @@
 #define OTA_EEPROM_FLASH_READ_LEN (sizeof(bootloader_flash_eeprom_data_t))
 #define OTA_EEPROM_FLASH_ERASE_SIZE (EEPROM_PAGE_SIZE)
 
+// The flags are kept in an append-only journal over these EEPROM pages (see ota_journal.h)
+// Flags written by older firmware are the raw struct at OTA_EEPROM_FLASH_OFFSET_FLAGS, read once when the journal is empty
+// libota keeps writing the raw struct until the bootloader announces journal support in the boot profile
+#define OTA_EEPROM_FLASH_JOURNAL_PAGES 8
+
+// OTA progress map lives in the EEPROM page right after the flags journal
+#define OTA_EEPROM_FLASH_OFFSET_PROGRESS (OTA_EEPROM_FLASH_OFFSET + OTA_EEPROM_FLASH_JOURNAL_PAGES * EEPROM_PAGE_SIZE)
+#define OTA_EEPROM_FLASH_PROGRESS_LEN (sizeof(ota_progress_map_t))
+
 #endif // __OTA_EEPROM_OFFSETS_H__
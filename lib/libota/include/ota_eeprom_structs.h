@@ -7,6 +7,7 @@
 #define __OTA_EEPROM_STRUCTS_H__
 
 #include "CH58x_common.h"
+#include "ota_flash_layout.h"
 
 typedef enum _current_flash_bank_t
 {
@@ -27,6 +28,7 @@ typedef enum _boot_reason_code_t
 {
     REASON_NORMAL = 0,
     REASON_FALLBACK_BOOT,
+    REASON_IMAGE_REJECTED,
     REASON_MAX = 0xff,
 } boot_reason_code_t;
 
@@ -36,6 +38,31 @@ typedef struct _bootloader_flash_eeprom_data_t
     uint8_t flash_mode_flag; // Flash mode flag
     uint8_t boot_reason_code; // Boot reason code
     uint8_t reserved[2]; // Reserved for future use (Padding)
+    uint32_t image_generation[2]; // Generation of the image in Bank A and B, bumped when libota starts to modify the bank
+    uint32_t image_verified[2]; // Generation the bootloader has verified the image of Bank A and B at
 } bootloader_flash_eeprom_data_t;
 
+// Image verdict cache, a bank image is only hashed again once its generation has changed
+// Erased EEPROM reads as OTA_IMAGE_GENERATION_NONE, which is never a verified generation
+#define OTA_IMAGE_GENERATION_NONE 0xFFFFFFFF
+#define OTA_IMAGE_GENERATION_NEXT(generation) ((generation) + 1 == OTA_IMAGE_GENERATION_NONE ? 0 : (generation) + 1)
+#define OTA_IMAGE_BANK_INDEX(bank) ((bank) == FLASH_BANK_A ? 0 : 1)
+
+// Number of flash erase blocks in a bank, tracked by the OTA progress map
+#define OTA_PROGRESS_PAGE_SIZE EEPROM_BLOCK_SIZE
+#define OTA_PROGRESS_PAGE_COUNT (OTA_FLASH_BANK_SIZE / OTA_PROGRESS_PAGE_SIZE)
+
+// Page states of the OTA progress map, a bit is cleared once the page reaches the state
+// 0xFF means nothing is known about the page
+#define OTA_PROGRESS_STATE_ERASED 0x01
+#define OTA_PROGRESS_STATE_PROGRAMMED 0x02
+#define OTA_PROGRESS_STATE_VERIFIED 0x04
+
+typedef struct _ota_progress_map_t
+{
+    uint32_t target_flash_bank; // Flash bank being updated (current_flash_bank_t), the map is void for any other
+    uint8_t pages[OTA_PROGRESS_PAGE_COUNT]; // Page states, one byte per flash erase block
+    uint8_t reserved[(4 - OTA_PROGRESS_PAGE_COUNT % 4) % 4]; // Reserved for future use (Padding)
+} ota_progress_map_t;
+
 #endif // __OTA_EEPROM_STRUCTS_H__
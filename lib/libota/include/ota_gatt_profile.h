@@ -22,6 +22,8 @@
 #define OTA_GATT_PROFILE_CHAR_UUID_FLASH_MODE_READABLE 0xFFE8
 #define OTA_GATT_PROFILE_CHAR_UUID_BOOT_REASON 0xFFE9
 #define OTA_GATT_PROFILE_CHAR_UUID_BOOT_REASON_READABLE 0xFFEA
+#define OTA_GATT_PROFILE_CHAR_UUID_BULK 0xFFEB
+#define OTA_GATT_PROFILE_CHAR_UUID_LINK 0xFFEC
 
 // Key Profile Services bit fields
 #define OTA_GATT_PROFILE_SERVICES 0x00000001
@@ -29,6 +31,68 @@
 // OTA IO Buffer Size
 #define OTA_IO_BUFFER_SIZE 512
 
+// Number of OTA IO buffers (ping-pong pair)
+#define OTA_IO_BUFFER_COUNT 2
+
+// OTA main characteristic status readback layout
+// byte 0: busy flag
+// byte 1: status of the last asynchronous event
+// byte 2-5: stream cursor (little-endian, 0 if no stream is open)
+// byte 6: index of the last batch sub-command
+// byte 7: IO buffer ownership, see OTA_IO_BUFFER_OWNER_*
+// byte 8-11: CRC-32 of the data programmed since the last erase or stream begin, read back from flash (little-endian)
+// The bulk data state has its own readback, see OTA_BULK_STATUS_LEN
+#define OTA_MAIN_STATUS_LEN 12
+
+// OTA main characteristic completion notification layout, sent when notifications are enabled
+// and an asynchronous command leaves the OTA engine idle
+// byte 0: opcode of the completed command (STREAM_BEGIN for stream chunks)
+// byte 1: status of the command
+// byte 2: index of the last batch sub-command
+// byte 3-: result on success, cut to the MTU:
+//          ERASE: number of blocks skipped because they were blank already (4 bytes, little-endian)
+//          VERIFY, VERIFY_PAGES and VERIFY_CRC: the result, the IO buffer holds all of it
+#define OTA_MAIN_NOTIFY_HEADER_LEN 3
+
+// OTA bulk data characteristic, written without response
+// Every write is a sequence number (2 bytes, little-endian) followed by the payload.
+// Sequence 0 starts over, the following writes count up and wrap around from 0xFFFF to 1.
+// Outside of a stream the payloads are appended to the IO buffer, for the next OTA command.
+// While a stream is open they are gathered in the IO buffers and handed to the stream as chunks,
+// so the payload length must be a multiple of 4.
+// A rejected write cannot be reported in a write response, it sets the bulk data state instead and
+// all further writes are dropped until the host starts over with sequence 0.
+// A write rejected as busy leaves nothing behind, even when its own payload was taken in and only handing
+// the full IO buffer to the stream failed: once an IO buffer is free again the bulk data state is notified,
+// and the host resumes by resending the next expected sequence number.
+// The device checks the bulk data itself: a stream fed from sequence 0 is closed by STREAM_END with the
+// expected CRC-32 of the stream, which is the bulk CRC below and is checked against the data read back
+// from flash. Outside of a stream the payloads are covered by the token of the command using the IO buffer.
+// Bulk writes never rotate the challenge.
+#define OTA_BULK_HEADER_LEN 2
+
+// OTA bulk data characteristic readback and notification layout
+// byte 0-1: next expected bulk sequence number (little-endian)
+// byte 2: bulk data state, see OTA_BULK_*
+// byte 3-6: CRC-32 of the bulk payloads accepted since sequence 0 (little-endian)
+#define OTA_BULK_STATUS_LEN 7
+
+// Bulk data states
+#define OTA_BULK_OK 0x00 // All writes accepted
+#define OTA_BULK_ERROR_SEQUENCE 0x01 // A write is missing or out of order
+#define OTA_BULK_ERROR_LENGTH 0x02 // Payload is malformed or exceeds the IO buffer or the stream
+#define OTA_BULK_ERROR_BUSY 0x03 // Both IO buffers are held by the OTA engine, the host sent too fast, resumable
+
+// IO buffer ownership bits
+#define OTA_IO_BUFFER_OWNER_HOST_MASK 0x01 // Index of the IO buffer the host reads and writes
+#define OTA_IO_BUFFER_OWNER_HELD(n) (0x02 << (n)) // IO buffer n is being programmed or queued
+
 bStatus_t OTAProfile_AddService(void);
 
+// Notify the host that an asynchronous OTA command has completed
+void OTAProfile_NotifyComplete(uint8_t opcode, bStatus_t status, const uint8_t *result, uint32_t resultLength);
+
+// Tell the host it can resume bulk data writes, after an asynchronous operation freed an IO buffer
+void OTAProfile_BulkResume(void);
+
 #endif // __OTA_GATT_PROFILE_H__
@@ -0,0 +1,38 @@
+// ota_image_manifest.h
+// This file contains the definitions for the image manifest stored at the end of each flash bank.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __OTA_IMAGE_MANIFEST_H__
+#define __OTA_IMAGE_MANIFEST_H__
+
+#include "CH58x_common.h"
+#include "ota_flash_layout.h"
+
+// Image manifest (see extra_scripts/image_manifest.py)
+// Written by the build into the last bytes of the bank, the linker keeps the image clear of it.
+// The bootloader checks the digest before booting a bank, CONFIRM checks the MAC before switching to it:
+//   digest = SHA256(image_length bytes from the bank entry)
+//   mac = AES-CMAC(ota_aes128_key, magic || version || image_length || reserved || digest)
+// CONFIRM also refuses a version lower than the one in the manifest of the running bank, so an older
+// image cannot be installed over the air even if it is validly signed. An equal version is accepted,
+// and a running bank without a valid manifest (e.g. flashed by wire) does not restrict the version.
+// The bootloader does not check the version, falling back to the previous bank after a failed boot is on purpose.
+// Keep in sync with extra_scripts/extra_components/bootloader/include/image_manifest.h
+#define OTA_IMAGE_MANIFEST_MAGIC 0x4D41544F // "OTAM"
+#define OTA_IMAGE_MANIFEST_SIZE 64
+#define OTA_IMAGE_MANIFEST_OFFSET (OTA_FLASH_BANK_SIZE - OTA_IMAGE_MANIFEST_SIZE)
+#define OTA_IMAGE_MANIFEST_MAC_LEN 16
+#define OTA_IMAGE_MANIFEST_SIGNED_LEN (OTA_IMAGE_MANIFEST_SIZE - OTA_IMAGE_MANIFEST_MAC_LEN)
+
+typedef struct _ota_image_manifest_t
+{
+    uint32_t magic; // OTA_IMAGE_MANIFEST_MAGIC
+    uint32_t version; // Firmware version, set by the build
+    uint32_t image_length; // Length of the image covered by the digest
+    uint32_t reserved; // Reserved for future use (0xFFFFFFFF)
+    uint8_t digest[32]; // SHA256 of the image
+    uint8_t mac[OTA_IMAGE_MANIFEST_MAC_LEN]; // AES-CMAC of all fields above
+} ota_image_manifest_t;
+
+#endif // __OTA_IMAGE_MANIFEST_H__
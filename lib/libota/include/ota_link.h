@@ -0,0 +1,104 @@
+// ota_link.h
+// This file contains the definitions and function prototypes for the OTA link manager.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __OTA_LINK_H__
+#define __OTA_LINK_H__
+
+#include "ota_common.h"
+
+// Largest ATT MTU the HCI buffers can carry, ATT_MTU = BLE_BUFF_MAX_LEN - 4 (see CH58xBLE_LIB.h)
+// The controller negotiates the LE data length up to BLE_BUFF_MAX_LEN by itself
+#if defined(BLE_BUFF_MAX_LEN) && (BLE_BUFF_MAX_LEN - 4 > ATT_MTU_SIZE)
+#define OTA_LINK_MAX_MTU (BLE_BUFF_MAX_LEN - 4)
+#else
+#define OTA_LINK_MAX_MTU ATT_MTU_SIZE
+#endif
+
+// Connection parameters while an OTA session is active: shortest interval, no latency
+// Interval in 1.25ms units, timeout in 10ms units
+#ifndef OTA_LINK_FAST_MIN_INTERVAL
+#define OTA_LINK_FAST_MIN_INTERVAL 6 // 7.5ms
+#endif
+#ifndef OTA_LINK_FAST_MAX_INTERVAL
+#define OTA_LINK_FAST_MAX_INTERVAL 12 // 15ms, the shortest interval some centrals accept
+#endif
+#ifndef OTA_LINK_FAST_LATENCY
+#define OTA_LINK_FAST_LATENCY 0
+#endif
+#ifndef OTA_LINK_FAST_TIMEOUT
+#define OTA_LINK_FAST_TIMEOUT 200 // 2s
+#endif
+
+// Connection parameters for the rest of the time, saving power
+#ifndef OTA_LINK_IDLE_MIN_INTERVAL
+#define OTA_LINK_IDLE_MIN_INTERVAL 80 // 100ms
+#endif
+#ifndef OTA_LINK_IDLE_MAX_INTERVAL
+#define OTA_LINK_IDLE_MAX_INTERVAL 160 // 200ms
+#endif
+#ifndef OTA_LINK_IDLE_LATENCY
+#define OTA_LINK_IDLE_LATENCY 4
+#endif
+#ifndef OTA_LINK_IDLE_TIMEOUT
+#define OTA_LINK_IDLE_TIMEOUT 600 // 6s
+#endif
+
+// Time without any OTA command after which the session is considered over, in ms
+#ifndef OTA_LINK_SESSION_TIMEOUT_MS
+#define OTA_LINK_SESSION_TIMEOUT_MS 30000
+#endif
+
+// Link manager events
+#define OTA_LINK_EVENT_SESSION_TIMEOUT 0x0001 // No OTA command for OTA_LINK_SESSION_TIMEOUT_MS
+
+// Connection parameter states
+#define OTA_LINK_PARAMS_IDLE 0x00 // Idle parameters requested
+#define OTA_LINK_PARAMS_FAST_PENDING 0x01 // Fast parameters requested, the central has not applied them yet
+#define OTA_LINK_PARAMS_FAST 0x02 // Fast parameters applied
+#define OTA_LINK_PARAMS_FAST_REJECTED 0x03 // Central applied other parameters than the fast ones
+
+// ATT Write Request / Write Command header: opcode (1 byte) + handle (2 bytes)
+#define OTA_LINK_ATT_WRITE_HEADER_LEN 3
+
+// OTA link characteristic value layout
+// byte 0-1: ATT MTU of the connection (little-endian)
+// byte 2-3: largest IO buffer write that fits in one ATT PDU (little-endian)
+// byte 4-5: largest bulk data payload that fits in one ATT PDU, a multiple of 4 for streams (little-endian)
+// byte 6: TX PHY (GAP_PHY_VAL_TYPE)
+// byte 7: RX PHY (GAP_PHY_VAL_TYPE)
+// byte 8-9: connection interval in 1.25ms units (little-endian, 0 until the first parameter update)
+// byte 10-11: slave latency (little-endian)
+// byte 12-13: supervision timeout in 10ms units (little-endian)
+// byte 14: connection parameter state, see OTA_LINK_PARAMS_*
+#define OTA_LINK_INFO_LEN 15
+
+// Prepare the link manager, called once when the OTA service is added
+bStatus_t ota_link_init(void);
+
+// Process the link manager events
+uint16_t ota_link_process_event(uint8_t task_id, uint16_t events);
+
+// A connection has been established, ask for the largest MTU
+void ota_link_connected(uint16_t connHandle, uint8_t taskId);
+
+// The PHY of a connection has been updated
+void ota_link_phy_updated(uint16_t connHandle, uint8_t txPhy, uint8_t rxPhy);
+
+// The connection parameters of a connection have been updated
+void ota_link_param_updated(uint16_t connHandle, uint16_t connInterval, uint16_t connSlaveLatency, uint16_t connTimeout);
+
+// An OTA command has been accepted, switch to the fast parameters and restart the session timeout
+void ota_link_session_activity(void);
+
+// The OTA session is over, switch back to the idle parameters
+void ota_link_session_end(void);
+
+// A connection has been terminated
+void ota_link_terminated(uint16_t connHandle);
+
+// Fill the OTA link characteristic value of a connection, returns its length
+uint16_t ota_link_get_info(uint16_t connHandle, uint8_t *buffer);
+
+#endif // __OTA_LINK_H__
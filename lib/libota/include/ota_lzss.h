@@ -0,0 +1,46 @@
+// ota_lzss.h
+// This file contains the definitions and function prototypes for the streaming LZSS decompressor used by compressed OTA programming.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __OTA_LZSS_H__
+#define __OTA_LZSS_H__
+
+#include "ota_common.h"
+
+// Compressed stream format (see extra_scripts/lzss_compress.py)
+// A flag byte announces the next 8 items, least significant bit first:
+//   bit = 1: literal, one byte copied as is
+//   bit = 0: match, two bytes: (offset - 1) low 8 bits, then (offset - 1) high 4 bits << 4 | (length - 3)
+// A match copies length bytes starting offset bytes before the current output position.
+// The window reaches back into flash that has already been programmed, so it spans PROGRAM_COMPRESSED commands.
+#define OTA_LZSS_WINDOW_SIZE 4096
+#define OTA_LZSS_MIN_MATCH 3
+#define OTA_LZSS_MAX_MATCH (OTA_LZSS_MIN_MATCH + 15)
+
+// Decompressor state, the input buffer must stay untouched while decoding
+typedef struct _ota_lzss_ctx_t {
+    const uint8_t *in;        // Compressed input
+    uint32_t in_length;       // Length of the compressed input
+    uint32_t in_offset;       // Offset of the next input byte
+    uint32_t out_address;     // Flash address of the next output byte
+    uint32_t match_address;   // Flash address of the next byte of the pending match
+    uint32_t match_remaining; // Bytes left in the pending match
+    uint8_t flags;            // Current flag byte
+    uint8_t flag_count;       // Items left in the current flag byte
+} ota_lzss_ctx_t;
+
+// Walk the compressed stream without producing output
+// history_length is the number of already programmed bytes in front of the output the window may reach into
+bStatus_t ota_lzss_check(const uint8_t *in, uint32_t in_length, uint32_t out_length, uint32_t history_length);
+
+// Start decoding a compressed stream to be programmed at out_address
+void ota_lzss_init(ota_lzss_ctx_t *ctx, const uint8_t *in, uint32_t in_length, uint32_t out_address);
+
+// Decode exactly out_length bytes into out, which will be programmed at ctx->out_address
+bStatus_t ota_lzss_decode(ota_lzss_ctx_t *ctx, uint8_t *out, uint32_t out_length);
+
+// Check if the whole compressed input has been consumed
+uint32_t ota_lzss_is_finished(const ota_lzss_ctx_t *ctx);
+
+#endif // __OTA_LZSS_H__
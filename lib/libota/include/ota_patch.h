@@ -0,0 +1,53 @@
+// ota_patch.h
+// This file contains the definitions and function prototypes for the patch engine used by delta OTA programming.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __OTA_PATCH_H__
+#define __OTA_PATCH_H__
+
+#include "ota_common.h"
+
+// Patch instruction stream (see extra_scripts/bank_diff.py)
+// Every instruction starts with its opcode byte, multi-byte fields are little-endian:
+//   COPY:   source offset (4 bytes) + length (2 bytes), copies bytes of the running bank
+//   INSERT: length (2 bytes) + length bytes of data
+//   DIFF:   source offset (4 bytes) + length (2 bytes) + delta runs, adds the deltas to bytes of the running bank
+// Source offsets are relative to the entry of the running bank.
+// Delta runs cover the DIFF length, each starts with a control byte:
+//   control < 0x80: (control + 1) delta bytes follow
+//   control >= 0x80: (control - 0x7F) bytes are unchanged
+// A patch only reads the running bank and its own instructions, never the bank being programmed,
+// so any patch command can be repeated after its range has been erased again.
+#define OTA_PATCH_OP_COPY 0x01
+#define OTA_PATCH_OP_INSERT 0x02
+#define OTA_PATCH_OP_DIFF 0x03
+
+#define OTA_PATCH_RUN_UNCHANGED 0x80
+
+// Patch engine state, the instruction buffer must stay untouched while applying
+typedef struct _ota_patch_ctx_t {
+    const uint8_t *in;        // Patch instructions
+    uint32_t in_length;       // Length of the patch instructions
+    uint32_t in_offset;       // Offset of the next instruction byte
+    uint32_t source_entry;    // Entry address of the running bank
+    uint32_t source_address;  // Flash address of the next source byte
+    uint32_t remaining;       // Output bytes left in the current instruction
+    uint32_t run_remaining;   // Bytes left in the current delta run
+    uint8_t opcode;           // Current instruction
+    uint8_t run_delta;        // Current delta run carries delta bytes
+} ota_patch_ctx_t;
+
+// Walk the patch instructions without producing output
+bStatus_t ota_patch_check(const uint8_t *in, uint32_t in_length, uint32_t out_length, uint32_t source_entry);
+
+// Start applying patch instructions against the running bank at source_entry
+void ota_patch_init(ota_patch_ctx_t *ctx, const uint8_t *in, uint32_t in_length, uint32_t source_entry);
+
+// Apply the patch instructions to produce exactly out_length bytes into out
+bStatus_t ota_patch_apply(ota_patch_ctx_t *ctx, uint8_t *out, uint32_t out_length);
+
+// Check if all patch instructions have been consumed
+uint32_t ota_patch_is_finished(const ota_patch_ctx_t *ctx);
+
+#endif // __OTA_PATCH_H__
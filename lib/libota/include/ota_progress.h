@@ -0,0 +1,28 @@
+// ota_progress.h
+// This file contains the function prototypes for the persistent OTA progress map of the inactive flash bank.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __OTA_PROGRESS_H__
+#define __OTA_PROGRESS_H__
+
+#include "ota_common.h"
+#include "ota_eeprom_offsets.h"
+#include "ota_eeprom_structs.h"
+
+// Get the progress map of the inactive flash bank, loaded from EEPROM on first use
+const ota_progress_map_t *ota_progress_get_map(void);
+
+// Pages touched by the range have been erased
+void ota_progress_mark_erased(uint32_t address, uint32_t length);
+
+// The range has been programmed, pages written front to back without a gap up to their last byte are complete
+void ota_progress_mark_programmed(uint32_t address, uint32_t length);
+
+// Save changes that have been held back, called when the OTA engine goes idle
+void ota_progress_flush(void);
+
+// Programmed pages fully inside the range have been verified
+void ota_progress_mark_verified(uint32_t address, uint32_t length);
+
+#endif // __OTA_PROGRESS_H__
@@ -5,15 +5,39 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "ota_async_event.h"
+#include "ota_cmd.h"
+#include "ota_lzss.h"
+#include "ota_patch.h"
+#include "ota_progress.h"
+#include "ota_digest.h"
+#include "eeprom_flags.h"
 #include "sha256_impl.h"
+#include "crc32_impl.h"
+#include "RTC.h"
 
 static uint32_t ota_is_busy = 0;
+static uint32_t ota_batch_running = 0;
 static bStatus_t ota_async_event_status = SUCCESS;
 static uint32_t current_offset, cmd_address, cmd_length, *data_buffer_length;
 static uint8_t *data_buffer;
+static const uint8_t *program_buffer;
 static uint8_t event_task_id;
+
+// Time budget of one pass and the measured cost of one step, in RTC cycles scaled by OTA_ASYNC_STEP_COST_SCALE
+static uint32_t time_budget = OTA_ASYNC_TIME_BUDGET;
+static uint32_t erase_step_cost = 0;
+static uint32_t verify_step_cost = 0;
+static uint32_t verify_crc_step_cost = 0;
+static uint32_t erase_skipped; // Blocks of the current erase that were blank already
+#define OTA_ASYNC_STEP_COST_SCALE 16
 static SHA256_CTX sha256_ctx;
-__attribute__((aligned(8))) static uint8_t sha256_hashbuf[256]; // SHA256 temp buffer
+static SHA256_CTX sha256_root_ctx; // Root digest over the page digests of a per-page verify
+__attribute__((aligned(8))) static uint8_t page_digest[32]; // Full digest of the last page of a per-page verify
+static uint32_t verify_crc; // Running CRC-32 of a CRC verify
+static uint32_t program_crc = CRC32_INIT; // Running CRC-32 of programmed data, read back from flash
+static ota_lzss_ctx_t lzss_ctx;
+static ota_patch_ctx_t patch_ctx;
+__attribute__((aligned(8))) static uint8_t program_slice[OTA_ASYNC_PROGRAM_SLICE_SIZE]; // Decompressed or patched slice to be programmed
 
 uint32_t ota_is_busy_flag(void)
 {
@@ -25,6 +49,267 @@ bStatus_t ota_get_async_event_status(void)
     return ota_async_event_status;
 }
 
+void ota_async_event_set_time_budget(uint32_t budget)
+{
+    time_budget = budget;
+}
+
+uint32_t ota_async_event_erase_skipped(void)
+{
+    return erase_skipped;
+}
+
+const uint8_t *ota_async_event_result(uint32_t *length)
+{
+    if (data_buffer == NULL) {
+        *length = 0;
+        return NULL;
+    }
+    *length = *data_buffer_length;
+    return data_buffer;
+}
+
+uint32_t ota_async_event_program_crc(void)
+{
+    return CRC32_FINAL(program_crc);
+}
+
+void ota_async_event_reset_program_crc(void)
+{
+    program_crc = CRC32_INIT;
+}
+
+const uint8_t *ota_async_event_program_buffer(void)
+{
+    if (!ota_is_busy || ota_batch_running)
+    {
+        return NULL;
+    }
+    return program_buffer;
+}
+
+/**
+ * @brief Get the time elapsed since a RTC timestamp
+ * 
+ * @param start RTC cycle count taken with RTC_GetCycle32k
+ * 
+ * @return uint32_t Elapsed RTC cycles (32 kHz)
+ */
+static uint32_t ota_async_event_elapsed(uint32_t start)
+{
+    uint32_t now = RTC_GetCycle32k();
+
+    if (now < start)
+    {
+        return now + (RTC_TIMER_MAX_VALUE - start); // RTC counter wrapped around, once a day
+    }
+    return now - start;
+}
+
+/**
+ * @brief Decide if another step of a given cost fits this pass
+ * 
+ * @param step_cost Moving average of the step cost
+ * @param pass_start RTC cycle count at the start of the pass
+ * 
+ * @return uint32_t 1 if another step fits the time budget, 0 otherwise
+ */
+static uint32_t ota_async_event_step_fits(uint32_t step_cost, uint32_t pass_start)
+{
+    return ota_async_event_elapsed(pass_start) * OTA_ASYNC_STEP_COST_SCALE + step_cost <=
+           time_budget * OTA_ASYNC_STEP_COST_SCALE;
+}
+
+/**
+ * @brief Measure the step that just finished and decide if another one fits this pass
+ * The step cost is a moving average, so interrupts of the BLE stack around connection events
+ * make the steps look more expensive and the pass ends earlier, an idle radio lets it run more steps.
+ * 
+ * @param step_cost Pointer to the moving average of the step cost
+ * @param pass_start RTC cycle count at the start of the pass
+ * @param step_start Pointer to the RTC cycle count at the start of the step, set to the start of the next one
+ * 
+ * @return uint32_t 1 if another step fits the time budget, 0 otherwise
+ */
+static uint32_t ota_async_event_budget_left(uint32_t *step_cost, uint32_t pass_start, uint32_t *step_start)
+{
+    uint32_t step = ota_async_event_elapsed(*step_start) * OTA_ASYNC_STEP_COST_SCALE;
+
+    // Moving average over about 4 steps, the first measurement is taken as is
+    if (*step_cost == 0) {
+        *step_cost = step;
+    } else {
+        *step_cost = *step_cost - (*step_cost >> 2) + (step >> 2);
+    }
+    *step_start = RTC_GetCycle32k();
+
+    return ota_async_event_step_fits(*step_cost, pass_start);
+}
+
+/**
+ * @brief Check if all flash sectors touched by an erase are blank already
+ * FLASH_ROM_ERASE erases whole sectors, so the check covers them beyond the range, otherwise skipping
+ * an erase could leave data next to the range that a plain erase would have removed.
+ * 
+ * @param address Start address of the erase
+ * @param length Length of the erase
+ * 
+ * @return uint32_t 1 if every word of the sectors reads 0xFFFFFFFF, 0 otherwise
+ */
+static uint32_t ota_async_event_erase_blank(uint32_t address, uint32_t length)
+{
+    // Code flash is memory mapped, blank checked in place with word reads
+    const uint32_t *word = (const uint32_t *)(uintptr_t)(address & ~(EEPROM_BLOCK_SIZE - 1));
+    const uint32_t *end = (const uint32_t *)(uintptr_t)((address + length + EEPROM_BLOCK_SIZE - 1) & ~(EEPROM_BLOCK_SIZE - 1));
+
+    while (word < end) {
+        if (*word++ != 0xFFFFFFFF) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Hash the next step of the verified range straight from the mapped flash
+ * 
+ * @param ctx SHA256 context to update
+ * @param limit Offset the step must not cross
+ */
+static void ota_async_event_hash_step(SHA256_CTX *ctx, uint32_t limit)
+{
+    uint32_t process_length = OTA_ASYNC_VERIFY_STEP_SIZE;
+
+    if (limit - current_offset < process_length) {
+        process_length = limit - current_offset; // Adjust length if less than the step size
+    }
+
+    // Code flash is memory mapped, banks are hashed in place without a copy
+    sha256_update(ctx, (const uint8_t *)(uintptr_t)(cmd_address + current_offset), process_length);
+    current_offset += process_length;
+}
+
+/**
+ * @brief Complete the current asynchronous operation
+ * If a batch is running and the operation succeeded, the batch resumes with its next sub-command.
+ * 
+ * @param status Result of the operation
+ */
+static void ota_async_event_complete(bStatus_t status)
+{
+    ota_async_event_status = status; // Set the status to the result
+
+    if (ota_batch_running && status == SUCCESS) {
+        // Keep the busy flag, the batch continues with its next sub-command
+        tmos_set_event(event_task_id, OTA_ASYNC_EVENT_BATCH);
+        return;
+    }
+
+    ota_batch_running = 0;
+    ota_is_busy = 0; // Clear the busy flag
+    program_buffer = NULL; // Release the program data buffer
+
+    // Let the command layer follow up, e.g. drop a stream whose chunk failed
+    ota_cmd_async_complete(status);
+}
+
+/**
+ * @brief Add a freshly programmed slice to the running CRC-32 and the running digest of programmed data
+ * The slice is read back from the mapped flash, so both reflect what has actually been written.
+ * 
+ * @param length Length of the slice at current_offset
+ * 
+ * @return bStatus_t OTA_STATUS_DIGEST_MISMATCH if the slice completes the digest range with a mismatch, SUCCESS otherwise
+ */
+static bStatus_t ota_async_event_program_readback(uint32_t length)
+{
+    program_crc = crc32_update(program_crc, (const uint8_t *)(uintptr_t)(cmd_address + current_offset), length);
+    return ota_digest_update(cmd_address + current_offset, length);
+}
+
+/**
+ * @brief Read the flash word at an address as it would be after programming a part of it
+ * 
+ * @param address Word aligned flash address
+ * @param data Pointer to the data to program at the address
+ * @param length Bytes of data for this word, 1 to 4, the rest of the word keeps the flash content
+ * @param current Pointer to store the current flash word
+ * 
+ * @return uint32_t Word to program
+ */
+static uint32_t ota_async_event_program_word(uint32_t address, const uint8_t *data, uint32_t length, uint32_t *current)
+{
+    uint32_t value;
+
+    // Code flash is memory mapped, the target is compared in place
+    *current = *(const uint32_t *)(uintptr_t)address;
+    value = *current;
+    // Must use tmos_memcpy to copy the value to avoid RISC-V misalignment faults
+    tmos_memcpy(&value, data, length);
+    return value;
+}
+
+/**
+ * @brief Program a slice, only writing the words that differ from the flash content
+ * Programming can only clear bits, a word that needs a bit to go from 0 to 1 rejects the whole slice
+ * before anything is written, so a missing erase is caught right away instead of at verify.
+ * 
+ * @param address Word aligned flash address of the slice
+ * @param data Pointer to the data of the slice
+ * @param length Length of the slice
+ * 
+ * @return bStatus_t SUCCESS, OTA_STATUS_ERASE_REQUIRED, or the error of FLASH_ROM_WRITE
+ */
+static bStatus_t ota_async_event_program_slice(uint32_t address, const uint8_t *data, uint32_t length)
+{
+    uint32_t offset, start, value, current, word_length;
+    uint8_t status;
+
+    for (offset = 0; offset < length; offset += sizeof(uint32_t)) {
+        word_length = length - offset < sizeof(uint32_t) ? length - offset : sizeof(uint32_t);
+        value = ota_async_event_program_word(address + offset, data + offset, word_length, &current);
+        if ((current & value) != value) {
+            return OTA_STATUS_ERASE_REQUIRED;
+        }
+    }
+
+    // Write the runs of differing words, identical words are skipped
+    offset = 0;
+    while (offset < length) {
+        start = offset;
+        while (offset < length) {
+            word_length = length - offset < sizeof(uint32_t) ? length - offset : sizeof(uint32_t);
+            value = ota_async_event_program_word(address + offset, data + offset, word_length, &current);
+            if (value == current) {
+                break;
+            }
+            offset += word_length;
+        }
+        if (offset > start) {
+            status = FLASH_ROM_WRITE(address + start, (uint8_t *)data + start, offset - start);
+            if (status != SUCCESS) {
+                return status;
+            }
+        } else {
+            offset += sizeof(uint32_t); // Identical word
+        }
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Complete the current program operation and record the programmed range in the progress map
+ * 
+ * @param status Result of the operation
+ */
+static void ota_async_event_program_complete(bStatus_t status)
+{
+    // Slices before current_offset have been written, even if the operation failed later on
+    ota_progress_mark_programmed(cmd_address, current_offset);
+    ota_async_event_complete(status);
+}
+
 bStatus_t ota_start_async_erase(uint32_t address, uint32_t length)
 {
     // Set the busy flag
@@ -35,11 +320,82 @@ bStatus_t ota_start_async_erase(uint32_t address, uint32_t length)
     current_offset = 0;
     cmd_address = address;
     cmd_length = length;
+    data_buffer = NULL;
+    data_buffer_length = NULL;
+    program_buffer = NULL;
+    erase_skipped = 0;
+
+    // Data programmed after an erase starts a new running CRC
+    // The running digest survives, unless the erase hits data it has already hashed
+    ota_async_event_reset_program_crc();
+    ota_digest_erased(address, length);
+
+    // The bank image changes, the bootloader has to verify it again
+    ota_invalidate_image_verdict();
 
     // Trigger the asynchronous erase event
     return tmos_set_event(event_task_id, OTA_ASYNC_EVENT_ERASE);
 }
 
+bStatus_t ota_start_async_program(uint32_t address, const uint8_t *data, uint32_t length)
+{
+    // Set the busy flag
+    ota_is_busy = 1;
+
+    // Store the address, length, and data buffer for the program operation
+    ota_async_event_status = blePending; // Set status to pending
+    current_offset = 0;
+    cmd_address = address;
+    cmd_length = length;
+    program_buffer = data;
+
+    // The bank image changes, the bootloader has to verify it again
+    ota_invalidate_image_verdict();
+
+    // Trigger the asynchronous program event
+    return tmos_set_event(event_task_id, OTA_ASYNC_EVENT_PROGRAM);
+}
+
+bStatus_t ota_start_async_program_compressed(uint32_t address, uint32_t length, const uint8_t *data, uint32_t data_length)
+{
+    // Set the busy flag
+    ota_is_busy = 1;
+
+    // Store the address and length of the decompressed data, the decompressor keeps the input
+    ota_async_event_status = blePending; // Set status to pending
+    current_offset = 0;
+    cmd_address = address;
+    cmd_length = length;
+    program_buffer = data;
+    ota_lzss_init(&lzss_ctx, data, data_length, address);
+
+    // The bank image changes, the bootloader has to verify it again
+    ota_invalidate_image_verdict();
+
+    // Trigger the asynchronous compressed program event
+    return tmos_set_event(event_task_id, OTA_ASYNC_EVENT_PROGRAM_COMPRESSED);
+}
+
+bStatus_t ota_start_async_program_patch(uint32_t address, uint32_t length, const uint8_t *patch, uint32_t patch_length, uint32_t source_entry)
+{
+    // Set the busy flag
+    ota_is_busy = 1;
+
+    // Store the address and length of the patched data, the patch engine keeps the instructions
+    ota_async_event_status = blePending; // Set status to pending
+    current_offset = 0;
+    cmd_address = address;
+    cmd_length = length;
+    program_buffer = patch;
+    ota_patch_init(&patch_ctx, patch, patch_length, source_entry);
+
+    // The bank image changes, the bootloader has to verify it again
+    ota_invalidate_image_verdict();
+
+    // Trigger the asynchronous patch program event
+    return tmos_set_event(event_task_id, OTA_ASYNC_EVENT_PROGRAM_PATCH);
+}
+
 bStatus_t ota_start_async_verify(uint32_t address, uint32_t length, uint8_t *buffer, uint32_t *buffer_length)
 {
     // Set the busy flag
@@ -52,6 +408,7 @@ bStatus_t ota_start_async_verify(uint32_t address, uint32_t length, uint8_t *buf
     cmd_length = length;
     data_buffer = buffer;
     data_buffer_length = buffer_length;
+    program_buffer = NULL;
 
     // Initialize SHA256 context
     sha256_init(&sha256_ctx);
@@ -60,6 +417,60 @@ bStatus_t ota_start_async_verify(uint32_t address, uint32_t length, uint8_t *buf
     return tmos_set_event(event_task_id, OTA_ASYNC_EVENT_VERIFY);
 }
 
+bStatus_t ota_start_async_verify_crc(uint32_t address, uint32_t length, uint8_t *buffer, uint32_t *buffer_length)
+{
+    // Set the busy flag
+    ota_is_busy = 1;
+
+    // Store the address, length, and data buffer for the verify CRC operation
+    ota_async_event_status = blePending; // Set status to pending
+    current_offset = 0;
+    cmd_address = address;
+    cmd_length = length;
+    data_buffer = buffer;
+    data_buffer_length = buffer_length;
+    program_buffer = NULL;
+    verify_crc = CRC32_INIT;
+
+    // Trigger the asynchronous verify CRC event
+    return tmos_set_event(event_task_id, OTA_ASYNC_EVENT_VERIFY_CRC);
+}
+
+bStatus_t ota_start_async_verify_pages(uint32_t address, uint32_t length, uint8_t *buffer, uint32_t *buffer_length)
+{
+    // Set the busy flag
+    ota_is_busy = 1;
+
+    // Store the address, length, and data buffer for the verify pages operation
+    ota_async_event_status = blePending; // Set status to pending
+    current_offset = 0;
+    cmd_address = address;
+    cmd_length = length;
+    data_buffer = buffer;
+    data_buffer_length = buffer_length;
+    program_buffer = NULL;
+
+    // Initialize SHA256 contexts for the first page and the root
+    sha256_init(&sha256_ctx);
+    sha256_init(&sha256_root_ctx);
+
+    // Trigger the asynchronous verify pages event
+    return tmos_set_event(event_task_id, OTA_ASYNC_EVENT_VERIFY_PAGES);
+}
+
+bStatus_t ota_start_async_batch(void)
+{
+    // Set the busy flag
+    ota_is_busy = 1;
+    ota_batch_running = 1;
+
+    // Set the status to pending
+    ota_async_event_status = blePending;
+
+    // Trigger the asynchronous batch event
+    return tmos_set_event(event_task_id, OTA_ASYNC_EVENT_BATCH);
+}
+
 bStatus_t ota_start_async_reboot(void)
 {
     // Set the busy flag
@@ -90,52 +501,164 @@ uint16_t ota_process_event(uint8_t task_id, uint16_t events)
 
     if (events & OTA_ASYNC_EVENT_ERASE) {
         // Handle asynchronous erase operation
+        // Erase block by block as long as the next block is expected to fit the time budget of this pass
+        // Blocks that are blank already are skipped, an inactive bank fresh from the factory is mostly blank
         uint8_t status;
-        uint32_t erase_length = EEPROM_BLOCK_SIZE;
-        if (cmd_length - current_offset < erase_length) {
-            erase_length = cmd_length - current_offset; // Adjust length if less than block size
+        uint32_t erase_length;
+        uint32_t next_fits;
+        uint32_t pass_start = RTC_GetCycle32k();
+        uint32_t step_start = pass_start;
+
+        do {
+            erase_length = EEPROM_BLOCK_SIZE;
+            if (cmd_length - current_offset < erase_length) {
+                erase_length = cmd_length - current_offset; // Adjust length if less than block size
+            }
+            if (ota_async_event_erase_blank(cmd_address + current_offset, erase_length)) {
+                // Skipped, a blank check must not drag down the measured cost of a real erase
+                erase_skipped++;
+                current_offset += erase_length;
+                step_start = RTC_GetCycle32k();
+                next_fits = ota_async_event_step_fits(erase_step_cost, pass_start);
+                continue;
+            }
+            status = FLASH_ROM_ERASE(cmd_address + current_offset, erase_length);
+            if (status != SUCCESS) {
+                ota_progress_mark_erased(cmd_address, current_offset); // Blocks before the failing one are erased
+                ota_async_event_complete(status); // Set the status to the error code
+                return events ^ OTA_ASYNC_EVENT_ERASE; // Clear the event after processing
+            }
+
+            // Success
+            current_offset += erase_length;
+            next_fits = ota_async_event_budget_left(&erase_step_cost, pass_start, &step_start);
+        } while (current_offset < cmd_length && next_fits);
+
+        if (current_offset >= cmd_length) {
+            ota_progress_mark_erased(cmd_address, cmd_length);
+            ota_async_event_complete(SUCCESS); // Set status to success
+
+            return events ^ OTA_ASYNC_EVENT_ERASE;
         }
-        status = FLASH_ROM_ERASE(cmd_address + current_offset, erase_length);
+
+        // Continue with the next erase operation
+        return events;
+    }
+
+    if (events & OTA_ASYNC_EVENT_PROGRAM) {
+        // Handle asynchronous program operation
+        uint8_t status;
+        uint32_t program_length = OTA_ASYNC_PROGRAM_SLICE_SIZE;
+        if (cmd_length - current_offset < program_length) {
+            program_length = cmd_length - current_offset; // Adjust length if less than slice size
+        }
+        status = ota_async_event_program_slice(cmd_address + current_offset, program_buffer + current_offset, program_length);
         if (status != SUCCESS) {
-            ota_async_event_status = status; // Set the status to the error code
-            ota_is_busy = 0; // Clear the busy flag
-            return events ^ OTA_ASYNC_EVENT_ERASE; // Clear the event after processing
+            ota_async_event_program_complete(status); // Set the status to the error code
+            return events ^ OTA_ASYNC_EVENT_PROGRAM; // Clear the event after processing
         }
 
-        // Success
-        current_offset += erase_length;
+        // Success, a mismatch of the running digest fails the operation that completes its range
+        status = ota_async_event_program_readback(program_length);
+        current_offset += program_length;
+        if (status != SUCCESS) {
+            ota_async_event_program_complete(status); // Set the status to the digest mismatch
+            return events ^ OTA_ASYNC_EVENT_PROGRAM;
+        }
         if (current_offset >= cmd_length) {
-            ota_async_event_status = SUCCESS; // Set status to success
-            ota_is_busy = 0; // Clear the busy flag
+            ota_async_event_program_complete(SUCCESS); // Set status to success
 
-            return events ^ OTA_ASYNC_EVENT_ERASE;
+            return events ^ OTA_ASYNC_EVENT_PROGRAM;
         }
 
-        // Continue with the next erase operation
+        // Yield to the BLE stack, continue with the next slice
         return events;
     }
 
-    if (events & OTA_ASYNC_EVENT_VERIFY) {
-        // Handle asynchronous verify operation
-        uint32_t process_length;
-        process_length = 256; // limit to 256 bytes per operation as SHA256 may take a long time
+    if (events & OTA_ASYNC_EVENT_PROGRAM_COMPRESSED) {
+        // Handle asynchronous compressed program operation, decompress one slice and program it
+        uint8_t status;
+        uint32_t program_length = OTA_ASYNC_PROGRAM_SLICE_SIZE;
+        if (cmd_length - current_offset < program_length) {
+            program_length = cmd_length - current_offset; // Adjust length if less than slice size
+        }
+        status = ota_lzss_decode(&lzss_ctx, program_slice, program_length);
+        if (status == SUCCESS) {
+            status = ota_async_event_program_slice(cmd_address + current_offset, program_slice, program_length);
+        }
+        if (status != SUCCESS) {
+            ota_async_event_program_complete(status); // Set the status to the error code
+            return events ^ OTA_ASYNC_EVENT_PROGRAM_COMPRESSED; // Clear the event after processing
+        }
+
+        // Success, a mismatch of the running digest fails the operation that completes its range
+        status = ota_async_event_program_readback(program_length);
+        current_offset += program_length;
+        if (status != SUCCESS) {
+            ota_async_event_program_complete(status); // Set the status to the digest mismatch
+            return events ^ OTA_ASYNC_EVENT_PROGRAM_COMPRESSED;
+        }
+        if (current_offset >= cmd_length) {
+            // The stream has been checked before, leftover input means it does not match the length
+            ota_async_event_program_complete(ota_lzss_is_finished(&lzss_ctx) ? SUCCESS : ATT_ERR_INVALID_VALUE_SIZE);
+
+            return events ^ OTA_ASYNC_EVENT_PROGRAM_COMPRESSED;
+        }
+
+        // Yield to the BLE stack, continue with the next slice
+        return events;
+    }
+
+    if (events & OTA_ASYNC_EVENT_PROGRAM_PATCH) {
+        // Handle asynchronous patch program operation, patch one slice and program it
+        uint8_t status;
+        uint32_t program_length = OTA_ASYNC_PROGRAM_SLICE_SIZE;
+        if (cmd_length - current_offset < program_length) {
+            program_length = cmd_length - current_offset; // Adjust length if less than slice size
+        }
+        status = ota_patch_apply(&patch_ctx, program_slice, program_length);
+        if (status == SUCCESS) {
+            status = ota_async_event_program_slice(cmd_address + current_offset, program_slice, program_length);
+        }
+        if (status != SUCCESS) {
+            ota_async_event_program_complete(status); // Set the status to the error code
+            return events ^ OTA_ASYNC_EVENT_PROGRAM_PATCH; // Clear the event after processing
+        }
+
+        // Success, a mismatch of the running digest fails the operation that completes its range
+        status = ota_async_event_program_readback(program_length);
+        current_offset += program_length;
+        if (status != SUCCESS) {
+            ota_async_event_program_complete(status); // Set the status to the digest mismatch
+            return events ^ OTA_ASYNC_EVENT_PROGRAM_PATCH;
+        }
+        if (current_offset >= cmd_length) {
+            // The patch has been checked before, leftover instructions mean it does not match the length
+            ota_async_event_program_complete(ota_patch_is_finished(&patch_ctx) ? SUCCESS : ATT_ERR_INVALID_VALUE_SIZE);
 
-        if (cmd_length - current_offset < process_length) {
-            process_length = cmd_length - current_offset; // Adjust length if less than 256 bytes
+            return events ^ OTA_ASYNC_EVENT_PROGRAM_PATCH;
         }
-        FLASH_ROM_READ(cmd_address + current_offset, sha256_hashbuf, process_length);
 
-        // Update SHA256 context with the read data
-        sha256_update(&sha256_ctx, (const uint8_t *)sha256_hashbuf, process_length);
-        current_offset += process_length;
+        // Yield to the BLE stack, continue with the next slice
+        return events;
+    }
+
+    if (events & OTA_ASYNC_EVENT_VERIFY) {
+        // Handle asynchronous verify operation
+        // Hash step by step as long as the next step is expected to fit the time budget of this pass
+        uint32_t pass_start = RTC_GetCycle32k();
+        uint32_t step_start = pass_start;
+
+        do {
+            ota_async_event_hash_step(&sha256_ctx, cmd_length);
+        } while (current_offset < cmd_length && ota_async_event_budget_left(&verify_step_cost, pass_start, &step_start));
 
         if (current_offset >= cmd_length) {
             // Finalize SHA256 hash calculation
             sha256_final(&sha256_ctx, data_buffer);
             *data_buffer_length = 32; // SHA256 produces a 32-byte hash
 
-            ota_async_event_status = SUCCESS; // Set status to success
-            ota_is_busy = 0; // Clear the busy flag
+            ota_async_event_complete(SUCCESS); // Set status to success
 
             return events ^ OTA_ASYNC_EVENT_VERIFY;
         }
@@ -144,6 +667,105 @@ uint16_t ota_process_event(uint8_t task_id, uint16_t events)
         return events;
     }
 
+    if (events & OTA_ASYNC_EVENT_VERIFY_CRC) {
+        // Handle asynchronous CRC verify operation
+        // Check step by step as long as the next step is expected to fit the time budget of this pass
+        uint32_t pass_start = RTC_GetCycle32k();
+        uint32_t step_start = pass_start;
+        uint32_t process_length;
+
+        do {
+            process_length = OTA_ASYNC_VERIFY_CRC_STEP_SIZE;
+            if (cmd_length - current_offset < process_length) {
+                process_length = cmd_length - current_offset; // Adjust length if less than the step size
+            }
+            // Code flash is memory mapped, banks are checked in place without a copy
+            verify_crc = crc32_update(verify_crc, (const uint8_t *)(uintptr_t)(cmd_address + current_offset), process_length);
+            current_offset += process_length;
+        } while (current_offset < cmd_length && ota_async_event_budget_left(&verify_crc_step_cost, pass_start, &step_start));
+
+        if (current_offset >= cmd_length) {
+            // Must use tmos_memcpy to copy the value to avoid RISC-V misalignment faults
+            verify_crc = CRC32_FINAL(verify_crc);
+            tmos_memcpy(data_buffer, &verify_crc, sizeof(uint32_t));
+            *data_buffer_length = sizeof(uint32_t);
+
+            ota_async_event_complete(SUCCESS); // Set status to success
+
+            return events ^ OTA_ASYNC_EVENT_VERIFY_CRC;
+        }
+
+        // Continue with the next read operation
+        return events;
+    }
+
+    if (events & OTA_ASYNC_EVENT_VERIFY_PAGES) {
+        // Handle asynchronous per-page verify operation
+        // Hash step by step as long as the next step is expected to fit the time budget of this pass
+        uint32_t pass_start = RTC_GetCycle32k();
+        uint32_t step_start = pass_start;
+        uint32_t page_end;
+        uint32_t page_index = 0;
+
+        do {
+            page_index = current_offset / OTA_CMD_VERIFY_PAGES_PAGE_SIZE;
+            page_end = (page_index + 1) * OTA_CMD_VERIFY_PAGES_PAGE_SIZE;
+            if (page_end > cmd_length) {
+                page_end = cmd_length; // Last page may be shorter
+            }
+            ota_async_event_hash_step(&sha256_ctx, page_end);
+
+            if (current_offset == page_end) {
+                // Page complete, the root takes the full page digest, the IO buffer its truncated form
+                sha256_final(&sha256_ctx, page_digest);
+                sha256_update(&sha256_root_ctx, (const uint8_t *)page_digest, 32);
+                tmos_memcpy(
+                    data_buffer + OTA_CMD_VERIFY_PAGES_ROOT_LEN + page_index * OTA_CMD_VERIFY_PAGES_DIGEST_LEN, 
+                    page_digest, 
+                    OTA_CMD_VERIFY_PAGES_DIGEST_LEN
+                );
+                sha256_init(&sha256_ctx);
+            }
+        } while (current_offset < cmd_length && ota_async_event_budget_left(&verify_step_cost, pass_start, &step_start));
+
+        if (current_offset >= cmd_length) {
+            // Finalize the root digest in front of the page digests
+            sha256_final(&sha256_root_ctx, data_buffer);
+            *data_buffer_length = OTA_CMD_VERIFY_PAGES_ROOT_LEN + (page_index + 1) * OTA_CMD_VERIFY_PAGES_DIGEST_LEN;
+
+            ota_async_event_complete(SUCCESS); // Set status to success
+
+            return events ^ OTA_ASYNC_EVENT_VERIFY_PAGES;
+        }
+
+        // Continue with the next read operation
+        return events;
+    }
+
+    if (events & OTA_ASYNC_EVENT_BATCH) {
+        // Handle asynchronous batch execution, one sub-command per pass
+        bStatus_t status;
+        if (!ota_cmd_batch_has_next()) {
+            ota_batch_running = 0;
+            ota_async_event_complete(SUCCESS); // All sub-commands done
+            return events ^ OTA_ASYNC_EVENT_BATCH;
+        }
+
+        status = ota_cmd_batch_step();
+        if (status == blePending) {
+            // Asynchronous sub-command started, it resumes the batch when it completes
+            return events ^ OTA_ASYNC_EVENT_BATCH;
+        }
+        if (status != SUCCESS) {
+            ota_batch_running = 0;
+            ota_async_event_complete(status); // Stop at the first failing sub-command
+            return events ^ OTA_ASYNC_EVENT_BATCH;
+        }
+
+        // Continue with the next sub-command
+        return events;
+    }
+
     // Handle asynchronous reboot operation
     if (events & OTA_ASYNC_EVENT_REBOOT) {
         // Perform the reboot operation
@@ -0,0 +1,81 @@
+// ota_boot_profile.c
+// This file contains the implementation of the boot time profile handed over by the bootloader.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ota_boot_profile.h"
+
+#define OTA_BOOT_PROFILE ((ota_boot_profile_t *)OTA_BOOT_PROFILE_ADDRESS)
+
+static const char *const ota_boot_phase_names[OTA_BOOT_PHASE_MAX] = {
+    "Bootloader Entry",
+    "Clock Setup",
+    "Console Setup",
+    "EEPROM Flags",
+    "Image Check",
+    "Jump",
+    "Application Main",
+    "Advertising",
+};
+
+/**
+ * @brief Get the boot profile
+ * 
+ * @return const ota_boot_profile_t* Pointer to the profile, NULL if the bootloader did not hand one over
+ */
+const ota_boot_profile_t *ota_boot_profile_get(void)
+{
+    if (OTA_BOOT_PROFILE->magic != OTA_BOOT_PROFILE_MAGIC)
+        return NULL; // e.g. flashed without the bootloader
+    return OTA_BOOT_PROFILE;
+}
+
+/**
+ * @brief Record the stamp of an application phase
+ * Only the first stamp of a phase is kept, e.g. advertising restarts after every disconnect.
+ * 
+ * @param phase Phase that has been reached
+ */
+void ota_boot_profile_mark(ota_boot_phase_t phase)
+{
+    if (ota_boot_profile_get() == NULL || phase >= OTA_BOOT_PHASE_MAX)
+        return;
+    if (OTA_BOOT_PROFILE->stamp[phase] != OTA_BOOT_PROFILE_STAMP_NONE)
+        return;
+    OTA_BOOT_PROFILE->stamp[phase] = RTC_GetCycle32k() + OTA_BOOT_PROFILE->rtc_offset;
+}
+
+/**
+ * @brief Keep the timeline going across an RTC restart
+ * HAL_TimeInit restarts the RTC from zero, stamps after it continue from the time of this call.
+ */
+void ota_boot_profile_rtc_restart(void)
+{
+    if (ota_boot_profile_get() == NULL)
+        return;
+    OTA_BOOT_PROFILE->rtc_offset += RTC_GetCycle32k();
+}
+
+/**
+ * @brief Print the time spent in each phase, in microseconds since the bootloader entry
+ */
+void ota_boot_profile_print(void)
+{
+    const ota_boot_profile_t *profile = ota_boot_profile_get();
+    uint32_t i, cycles;
+
+    if (profile == NULL)
+    {
+        PRINT("Boot Profile: not available\r\n");
+        return;
+    }
+    PRINT("Boot Profile (%s path):\r\n", profile->fast_path ? "fast" : "normal");
+    for (i = 0; i < OTA_BOOT_PHASE_MAX; i++)
+    {
+        if (profile->stamp[i] == OTA_BOOT_PROFILE_STAMP_NONE)
+            continue; // Phase skipped
+        // 32768 cycles per second, 1000000 / 32768 = 15625 / 512
+        cycles = profile->stamp[i] - profile->stamp[OTA_BOOT_PHASE_ENTRY];
+        PRINT(" - %s: %lu us\r\n", ota_boot_phase_names[i], (unsigned long)((uint64_t)cycles * 15625 / 512));
+    }
+}
@@ -9,6 +9,12 @@
 #include "ota_flash_layout.h"
 #include "eeprom_flags.h"
 #include "ota_async_event.h"
+#include "ota_lzss.h"
+#include "ota_patch.h"
+#include "ota_progress.h"
+#include "ota_digest.h"
+#include "ota_image_manifest.h"
+#include "ota_link.h"
 
 #ifndef OTA_GATT_AES128_KEY_BYTES
 #error "OTA module needs a 128-bit AES-CMAC Key defined in platformio.ini or build CFLAGS!"
@@ -28,6 +34,41 @@ __attribute__((aligned(8))) const uint8_t ota_aes128_key[16] = OTA_GATT_AES128_K
 __attribute__((aligned(8))) static char aes_cmac_challenge_full_buffer[16 + 16 + 16 + 16]; 
 __attribute__((aligned(8))) static char aes_cmac_temp_cmd_buffer[OTA_CMD_ARGS_MAX_LEN];
 
+// Subkeys of ota_aes128_key, generated once on first use instead of for every AES-CMAC
+__attribute__((aligned(8))) static aes_cmac_key_t ota_aes128_key_ctx;
+static uint32_t ota_aes128_key_ctx_ready = 0;
+static aes_cmac_ctx_t aes_cmac_ctx;
+
+// Session state, the session key is derived once per connection by SESSION_BEGIN
+// 16 bytes for io_buffer AES-CMAC, 16 bytes for result
+__attribute__((aligned(8))) static aes_cmac_key_t session_key_ctx;
+__attribute__((aligned(8))) static char session_mac_buffer[16 + 16];
+static uint32_t session_active = 0;
+static uint32_t session_counter = 0;
+
+// Streaming program session state
+static uint32_t stream_active = 0;
+static uint32_t stream_cursor = 0;
+static uint32_t stream_end = 0;
+
+// Stream chunk queued behind the chunk currently programmed from the other IO buffer
+static const uint8_t *stream_pending_data = NULL;
+static uint32_t stream_pending_address = 0;
+static uint32_t stream_pending_length = 0;
+
+// Batch execution state, the sub-command list is copied out of the IO buffer
+// so that VERIFY results written to the IO buffer cannot clobber it
+__attribute__((aligned(8))) static uint8_t batch_buffer[OTA_IO_BUFFER_SIZE];
+static uint32_t batch_length = 0;
+static uint32_t batch_offset = 0;
+static uint8_t batch_index = 0;
+static uint8_t *batch_io_buffer;
+static uint32_t *batch_io_buffer_length;
+
+// Opcode of the running asynchronous command, reported in its completion notification
+// STREAM_BEGIN while a stream chunk is programmed
+static uint8_t async_opcode = OTA_CMD_OPCODE_MAX;
+
 // OTA command argument lengths for each command
 const uint8_t ota_cmd_args_length_table[OTA_CMD_OPCODE_MAX] = {
     OTA_CMD_ARGS_READ_LEN,    // Read command length
@@ -36,6 +77,18 @@ const uint8_t ota_cmd_args_length_table[OTA_CMD_OPCODE_MAX] = {
     OTA_CMD_ARGS_VERIFY_LEN,  // Verify command length
     OTA_CMD_ARGS_REBOOT_LEN,  // Reboot command length
     OTA_CMD_ARGS_CONFIRM_LEN, // Confirm command length
+    OTA_CMD_ARGS_STREAM_BEGIN_LEN, // Stream begin command length
+    OTA_CMD_ARGS_STREAM_END_LEN,   // Stream end command length
+    OTA_CMD_ARGS_BATCH_LEN,   // Batch command length
+    OTA_CMD_ARGS_SESSION_BEGIN_LEN, // Session begin command length
+    OTA_CMD_ARGS_PROGRAM_COMPRESSED_LEN, // Program compressed command length
+    OTA_CMD_ARGS_PATCH_LEN,   // Patch command length
+    OTA_CMD_ARGS_PROGRESS_LEN, // Progress command length
+    OTA_CMD_ARGS_PROGRESS_VERIFIED_LEN, // Progress verified command length
+    OTA_CMD_ARGS_VERIFY_PAGES_LEN, // Verify pages command length
+    OTA_CMD_ARGS_VERIFY_CRC_LEN, // Verify CRC command length
+    OTA_CMD_ARGS_DIGEST_BEGIN_LEN, // Digest begin command length
+    OTA_CMD_ARGS_DIGEST_STATUS_LEN, // Digest status command length
 };
 
 // Table for OTA command argument if the command has io_buffer
@@ -46,8 +99,30 @@ const uint8_t ota_cmd_args_io_buffer_table[OTA_CMD_OPCODE_MAX] = {
     0, // Verify command has io_buffer (sha256 out buffer is used for response)
     0, // Reboot command does not have io_buffer
     0, // Confirm command does not have io_buffer
+    0, // Stream begin command does not have io_buffer (stream data is not covered by the token)
+    0, // Stream end command does not have io_buffer
+    1, // Batch command has io_buffer (sub-command list)
+    0, // Session begin command does not have io_buffer
+    1, // Program compressed command has io_buffer (compressed firmware buffer)
+    1, // Patch command has io_buffer (patch instructions)
+    0, // Progress command does not have io_buffer (progress map is returned in it)
+    0, // Progress verified command does not have io_buffer
+    0, // Verify pages command does not have io_buffer (digests are returned in it)
+    0, // Verify CRC command does not have io_buffer (CRC is returned in it)
+    1, // Digest begin command has io_buffer (expected digest)
+    0, // Digest status command does not have io_buffer (digest is returned in it)
 };
 
+/**
+ * @brief Generate the subkeys of ota_aes128_key on first use
+ */
+static void ota_cmd_prepare_key_ctx(void) {
+    if (!ota_aes128_key_ctx_ready) {
+        aes_cmac_key_init(&ota_aes128_key_ctx, ota_aes128_key);
+        ota_aes128_key_ctx_ready = 1;
+    }
+}
+
 /**
  * @brief Check if the OTA request is valid
  *
@@ -61,12 +136,18 @@ bStatus_t ota_cmd_is_valid(const uint8_t *buffer, uint32_t length) {
         return ATT_ERR_INVALID_VALUE; // Buffer too short to contain a valid command
     }
 
-    uint8_t opcode = buffer[0]; // First byte is the command opcode
+    uint8_t opcode = buffer[0] & ~OTA_CMD_SESSION_FLAG; // First byte is the command opcode
     if (opcode >= OTA_CMD_OPCODE_MAX) {
         return ATT_ERR_INVALID_VALUE; // Invalid command opcode
     }
 
     uint32_t expected_length = ota_cmd_args_length_table[opcode];
+    if (buffer[0] & OTA_CMD_SESSION_FLAG) {
+        if (opcode == OTA_CMD_OPCODE_SESSION_BEGIN) {
+            return ATT_ERR_INVALID_VALUE; // A session can only be opened with the challenge
+        }
+        expected_length += OTA_CMD_SESSION_TRAILER_LEN; // Counter and tag are appended
+    }
     if (length != expected_length + sizeof(uint8_t)) {
         return ATT_ERR_INVALID_VALUE_SIZE; // Buffer too short for the expected command length
     }
@@ -107,26 +188,20 @@ bStatus_t ota_cmd_is_authenticated(
 
     // Prepare the full buffer for AES-CMAC calculation
     tmos_memset(aes_cmac_challenge_full_buffer, 0, sizeof(aes_cmac_challenge_full_buffer));
+    ota_cmd_prepare_key_ctx();
     
     // 1. Calculate the AES-CMAC of the command buffer
-    // Copy the command buffer to the aligned temporary command buffer for AES-CMAC Hardware Acceleration
-    tmos_memcpy(aes_cmac_temp_cmd_buffer, buffer, length);
-    AES_CMAC(
-        (uint8_t *)ota_aes128_key, 
-        (uint8_t *)aes_cmac_temp_cmd_buffer, 
-        length, 
-        (uint8_t *)aes_cmac_challenge_full_buffer
-    );
+    // The context buffers the data itself, so the command needs no aligned copy
+    aes_cmac_init(&aes_cmac_ctx, &ota_aes128_key_ctx);
+    aes_cmac_update(&aes_cmac_ctx, buffer, length);
+    aes_cmac_final(&aes_cmac_ctx, (uint8_t *)aes_cmac_challenge_full_buffer);
 
     // 2. Calculate the AES-CMAC of the IO buffer (Already aligned)
     // If the IO buffer empty, we set the AES-CMAC to zero
     if(io_buffer_length != 0 && ota_cmd_args_io_buffer_table[buffer[0]] == 1) {
-        AES_CMAC(
-            (uint8_t *)ota_aes128_key, 
-            (uint8_t *)io_buffer, 
-            io_buffer_length, 
-            (uint8_t *)(aes_cmac_challenge_full_buffer + 16)
-        );
+        aes_cmac_init(&aes_cmac_ctx, &ota_aes128_key_ctx);
+        aes_cmac_update(&aes_cmac_ctx, io_buffer, io_buffer_length);
+        aes_cmac_final(&aes_cmac_ctx, (uint8_t *)(aes_cmac_challenge_full_buffer + 16));
     } else {
         tmos_memset(aes_cmac_challenge_full_buffer + 16, 0, 16);
     }
@@ -140,12 +215,9 @@ bStatus_t ota_cmd_is_authenticated(
 
     // 4. Calculate the AES-CMAC of the full buffer
     // Store the result in the last 16 bytes of the buffer
-    AES_CMAC(
-        (uint8_t *)ota_aes128_key, 
-        (uint8_t *)aes_cmac_challenge_full_buffer, 
-        16 + 16 + 16, 
-        (uint8_t *)(aes_cmac_challenge_full_buffer + 16 + 16 + 16) 
-    );
+    aes_cmac_init(&aes_cmac_ctx, &ota_aes128_key_ctx);
+    aes_cmac_update(&aes_cmac_ctx, (uint8_t *)aes_cmac_challenge_full_buffer, 16 + 16 + 16);
+    aes_cmac_final(&aes_cmac_ctx, (uint8_t *)(aes_cmac_challenge_full_buffer + 16 + 16 + 16));
 
     // 5. Compare the calculated AES-CMAC with the provided token
     if(mem_equal(
@@ -159,6 +231,66 @@ bStatus_t ota_cmd_is_authenticated(
     return SUCCESS;
 }
 
+/**
+ * @brief Check if the OTA command is authenticated by the session key
+ * 
+ * @param buffer Pointer to the buffer containing the OTA command with counter and tag (must already be checked by caller)
+ * @param length Length of the OTA command in the buffer, including counter and tag (must already be checked by caller)
+ * @param io_buffer Pointer to the IO buffer where the command data is stored (must be aligned)
+ * @param io_buffer_length Length of the IO buffer (must already be checked by caller)
+ * 
+ * @return bStatus_t Result of the authentication check
+ */
+bStatus_t ota_cmd_is_session_authenticated(
+    const uint8_t *buffer, 
+    uint32_t length, 
+    const uint8_t *io_buffer, 
+    uint32_t io_buffer_length
+) {
+    uint32_t cmd_length = length - OTA_CMD_SESSION_TRAILER_LEN;
+    uint32_t counter;
+
+    if(!session_active) {
+        return ATT_ERR_INSUFFICIENT_AUTHEN; // No session key negotiated
+    }
+
+    // Reject replayed or reordered commands
+    tmos_memcpy(&counter, buffer + cmd_length, sizeof(uint32_t));
+    if(counter <= session_counter) {
+        return ATT_ERR_INSUFFICIENT_AUTHEN;
+    }
+
+    // 1. AES-CMAC of the IO buffer (Already aligned), zero if the command has none
+    if(io_buffer_length != 0 && ota_cmd_args_io_buffer_table[buffer[0] & ~OTA_CMD_SESSION_FLAG] == 1) {
+        aes_cmac_init(&aes_cmac_ctx, &session_key_ctx);
+        aes_cmac_update(&aes_cmac_ctx, io_buffer, io_buffer_length);
+        aes_cmac_final(&aes_cmac_ctx, (uint8_t *)session_mac_buffer);
+    } else {
+        tmos_memset(session_mac_buffer, 0, 16);
+    }
+
+    // 2. AES-CMAC of counter, command as sent (including the session flag) and IO buffer AES-CMAC
+    // Store the result after the IO buffer AES-CMAC
+    aes_cmac_init(&aes_cmac_ctx, &session_key_ctx);
+    aes_cmac_update(&aes_cmac_ctx, buffer + cmd_length, OTA_CMD_SESSION_COUNTER_LEN);
+    aes_cmac_update(&aes_cmac_ctx, buffer, cmd_length);
+    aes_cmac_update(&aes_cmac_ctx, (uint8_t *)session_mac_buffer, 16);
+    aes_cmac_final(&aes_cmac_ctx, (uint8_t *)(session_mac_buffer + 16));
+
+    // 3. Compare the truncated AES-CMAC with the provided tag
+    if(mem_equal(
+        buffer + cmd_length + OTA_CMD_SESSION_COUNTER_LEN, 
+        session_mac_buffer + 16, 
+        OTA_CMD_SESSION_TAG_LEN
+    ) == 0) {
+        return ATT_ERR_INSUFFICIENT_AUTHEN;
+    }
+
+    // Counter is consumed even if the command fails later on
+    session_counter = counter;
+    return SUCCESS;
+}
+
 /**
  * @brief Check if the address and length are valid for the OTA command
  * 
@@ -241,6 +373,10 @@ bStatus_t ota_cmd_do_read(ota_cmd_args_read_t *args) {
 bStatus_t ota_cmd_do_program(ota_cmd_args_program_t *args) {
     bStatus_t status;
 
+    if (stream_active) {
+        return bleIncorrectMode; // IO buffer writes belong to the open stream
+    }
+
     // Write can only be used to program the flash bank that is not currently active
     status = ota_cmd_address_length_check(
         args->address, 
@@ -251,14 +387,76 @@ bStatus_t ota_cmd_do_program(ota_cmd_args_program_t *args) {
     if (status != SUCCESS) {
         return status; // Address or length check failed
     }
+    if ((args->address & 0x03) != 0 || (args->length & 0x03) != 0) {
+        return bleInvalidRange; // Flash is compared and programmed word by word
+    }
+
+    // Schedule an asynchronous program operation, the data stays in place while busy
+    return ota_start_async_program(args->address, args->data, args->length);
+}
+
+bStatus_t ota_cmd_do_program_compressed(ota_cmd_args_program_compressed_t *args) {
+    bStatus_t status;
+    current_flash_bank_t target_bank;
+    uint32_t history_length;
+
+    if (stream_active) {
+        return bleIncorrectMode; // IO buffer writes belong to the open stream
+    }
+
+    // Write can only be used to program the flash bank that is not currently active
+    target_bank = ota_get_flags_current_flash_bank() == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A;
+    status = ota_cmd_address_length_check(args->address, args->length, target_bank);
+
+    if (status != SUCCESS) {
+        return status; // Address or length check failed
+    }
+    if ((args->address & 0x03) != 0 || (args->length & 0x03) != 0) {
+        return bleInvalidRange; // Flash programming works on whole words
+    }
 
-    status = FLASH_ROM_WRITE(
-        args->address,
-        args->data,
-        args->length
+    // Matches may reach back into the target bank in front of the address, but never into the other bank
+    history_length = args->address - (target_bank == FLASH_BANK_A ? OTA_FLASH_BANK_A_ENTRY : OTA_FLASH_BANK_B_ENTRY);
+    status = ota_lzss_check(args->data, args->data_length, args->length, history_length);
+    if (status != SUCCESS) {
+        return status; // Malformed compressed data, nothing has been programmed
+    }
+
+    // Schedule an asynchronous compressed program operation, the data stays in place while busy
+    return ota_start_async_program_compressed(args->address, args->length, args->data, args->data_length);
+}
+
+bStatus_t ota_cmd_do_patch(ota_cmd_args_patch_t *args) {
+    bStatus_t status;
+    current_flash_bank_t running_bank = ota_get_flags_current_flash_bank();
+    uint32_t source_entry;
+
+    if (stream_active) {
+        return bleIncorrectMode; // IO buffer writes belong to the open stream
+    }
+
+    // Patch programs the flash bank that is not currently active, from the one that is
+    status = ota_cmd_address_length_check(
+        args->address, 
+        args->length, 
+        running_bank == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A
     );
 
-    return status;
+    if (status != SUCCESS) {
+        return status; // Address or length check failed
+    }
+    if ((args->address & 0x03) != 0 || (args->length & 0x03) != 0) {
+        return bleInvalidRange; // Flash programming works on whole words
+    }
+
+    source_entry = running_bank == FLASH_BANK_A ? OTA_FLASH_BANK_A_ENTRY : OTA_FLASH_BANK_B_ENTRY;
+    status = ota_patch_check(args->patch, args->patch_length, args->length, source_entry);
+    if (status != SUCCESS) {
+        return status; // Malformed patch, nothing has been programmed
+    }
+
+    // Schedule an asynchronous patch program operation, the instructions stay in place while busy
+    return ota_start_async_program_patch(args->address, args->length, args->patch, args->patch_length, source_entry);
 }
 
 bStatus_t ota_cmd_do_erase(ota_cmd_args_erase_t *args) {
@@ -274,7 +472,7 @@ bStatus_t ota_cmd_do_erase(ota_cmd_args_erase_t *args) {
         return status; // Address or length check failed
     }
 
-    // Schedule an asynchronous erase operation
+    // Schedule an asynchronous erase operation, the IO buffer is left untouched
     return ota_start_async_erase(args->address, args->length);
 }
 
@@ -301,22 +499,519 @@ bStatus_t ota_cmd_do_verify(ota_cmd_args_verify_t *args) {
     return ota_start_async_verify(args->address, args->length, args->result, args->result_length);
 }
 
+bStatus_t ota_cmd_do_verify_crc(ota_cmd_args_verify_t *args) {
+    // Verify CRC can be used to check the flash bank that is currently active or the other bank
+    bStatus_t status;
+    status = ota_cmd_address_length_check(
+        args->address, 
+        args->length, 
+        FLASH_BANK_A
+    );
+    if (status != SUCCESS) {
+        status = ota_cmd_address_length_check(
+            args->address, 
+            args->length, 
+            FLASH_BANK_B
+        );
+    }
+    if (status != SUCCESS) {
+        return status; // Address or length check failed
+    }
+
+    // Schedule an asynchronous verify CRC operation
+    return ota_start_async_verify_crc(args->address, args->length, args->result, args->result_length);
+}
+
+bStatus_t ota_cmd_do_digest_begin(ota_cmd_args_erase_t *args, const uint8_t *expected, uint32_t expected_length) {
+    // The running digest only follows programming, so only the flash bank that is not currently active
+    bStatus_t status;
+    status = ota_cmd_address_length_check(
+        args->address, 
+        args->length, 
+        ota_get_flags_current_flash_bank() == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A
+    );
+
+    if (status != SUCCESS) {
+        return status; // Address or length check failed
+    }
+    if (expected_length != 0 && expected_length != OTA_CMD_DIGEST_LEN) {
+        return ATT_ERR_INVALID_VALUE_SIZE; // Expected digest is a whole SHA256 digest or nothing
+    }
+
+    // Any previous running digest is discarded
+    ota_digest_begin(args->address, args->length, expected_length != 0 ? expected : NULL);
+    return SUCCESS;
+}
+
+bStatus_t ota_cmd_do_digest_status(uint8_t *buffer, uint32_t *buffer_length) {
+    if (*buffer_length < OTA_CMD_DIGEST_STATUS_LEN) {
+        return ATT_ERR_INSUFFICIENT_RESOURCES; // Should not happen, the IO buffer holds the whole status
+    }
+
+    // Return the state and the digest in the IO buffer
+    buffer[0] = (uint8_t)ota_digest_get_state();
+    tmos_memcpy(buffer + 1, ota_digest_get_result(), OTA_CMD_DIGEST_LEN);
+    *buffer_length = OTA_CMD_DIGEST_STATUS_LEN;
+
+    return SUCCESS;
+}
+
+bStatus_t ota_cmd_do_verify_pages(ota_cmd_args_verify_t *args) {
+    // Verify pages can be used on the flash bank that is currently active or the other bank
+    bStatus_t status;
+    uint32_t page_count;
+
+    status = ota_cmd_address_length_check(
+        args->address, 
+        args->length, 
+        FLASH_BANK_A
+    );
+    if (status != SUCCESS) {
+        status = ota_cmd_address_length_check(
+            args->address, 
+            args->length, 
+            FLASH_BANK_B
+        );
+    }
+    if (status != SUCCESS) {
+        return status; // Address or length check failed
+    }
+    if ((args->address & (OTA_CMD_VERIFY_PAGES_PAGE_SIZE - 1)) != 0) {
+        return bleInvalidRange; // Pages must line up with the host manifest
+    }
+
+    page_count = (args->length + OTA_CMD_VERIFY_PAGES_PAGE_SIZE - 1) / OTA_CMD_VERIFY_PAGES_PAGE_SIZE;
+    if (OTA_CMD_VERIFY_PAGES_ROOT_LEN + page_count * OTA_CMD_VERIFY_PAGES_DIGEST_LEN > OTA_IO_BUFFER_SIZE) {
+        return ATT_ERR_INSUFFICIENT_RESOURCES; // Should not happen, a whole bank fits the IO buffer
+    }
+
+    // Schedule an asynchronous verify pages operation
+    return ota_start_async_verify_pages(args->address, args->length, args->result, args->result_length);
+}
+
 bStatus_t ota_cmd_do_reboot(void) {
     // Schedule an asynchronous reboot operation
     return ota_start_async_reboot();
 }
 
+/**
+ * @brief Get the image manifest at the end of a flash bank
+ * 
+ * @param bank Flash bank of the manifest
+ * 
+ * @return const ota_image_manifest_t* Pointer to the manifest, not checked yet
+ */
+static const ota_image_manifest_t *ota_cmd_get_manifest(current_flash_bank_t bank) {
+    uint32_t entry = bank == FLASH_BANK_A ? OTA_FLASH_BANK_A_ENTRY : OTA_FLASH_BANK_B_ENTRY;
+    // Code flash is memory mapped, the manifest is read in place
+    return (const ota_image_manifest_t *)(uintptr_t)(entry + OTA_IMAGE_MANIFEST_OFFSET);
+}
+
+/**
+ * @brief Check the image manifest at the end of a flash bank
+ * Only the MAC is checked here, the bootloader checks the image digest before booting the bank.
+ * 
+ * @param bank Flash bank to check
+ * 
+ * @return bStatus_t SUCCESS, or OTA_STATUS_MANIFEST_INVALID if the manifest is missing or forged
+ */
+static bStatus_t ota_cmd_check_manifest(current_flash_bank_t bank) {
+    const ota_image_manifest_t *manifest = ota_cmd_get_manifest(bank);
+    bStatus_t status = SUCCESS;
+
+    if (manifest->magic != OTA_IMAGE_MANIFEST_MAGIC) {
+        return OTA_STATUS_MANIFEST_INVALID; // No manifest, e.g. not programmed by the host
+    }
+    if (manifest->image_length == 0 || manifest->image_length > OTA_IMAGE_MANIFEST_OFFSET) {
+        return OTA_STATUS_MANIFEST_INVALID; // Image would overlap the manifest
+    }
+
+    // mac = AES-CMAC(ota_aes128_key, manifest fields in front of the MAC)
+    ota_cmd_prepare_key_ctx();
+    aes_cmac_init(&aes_cmac_ctx, &ota_aes128_key_ctx);
+    aes_cmac_update(&aes_cmac_ctx, (const uint8_t *)manifest, OTA_IMAGE_MANIFEST_SIGNED_LEN);
+    aes_cmac_final(&aes_cmac_ctx, (uint8_t *)aes_cmac_challenge_full_buffer);
+    if (mem_equal(manifest->mac, aes_cmac_challenge_full_buffer, OTA_IMAGE_MANIFEST_MAC_LEN) == 0) {
+        status = OTA_STATUS_MANIFEST_INVALID;
+    }
+    tmos_memset(aes_cmac_challenge_full_buffer, 0, sizeof(aes_cmac_challenge_full_buffer));
+
+    return status;
+}
+
 bStatus_t ota_cmd_do_confirm(void) {
+    // Never switch to a bank that was not built and signed for this device
+    current_flash_bank_t running_bank = ota_get_flags_current_flash_bank();
+    current_flash_bank_t target_bank = running_bank == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A;
+    bStatus_t status;
+    status = ota_cmd_check_manifest(target_bank);
+    if (status != SUCCESS) {
+        return status; // Manifest check failed
+    }
+
+    // Never switch back to an older image, even a validly signed one
+    // The running version only counts if its own manifest checks out, e.g. not for an image flashed without one
+    if (ota_cmd_check_manifest(running_bank) == SUCCESS &&
+        ota_cmd_get_manifest(target_bank)->version < ota_cmd_get_manifest(running_bank)->version) {
+        return OTA_STATUS_MANIFEST_INVALID; // Rollback to an older version
+    }
+
     // Mark the current flash bank as flashed and set the boot reason to normal
     // Bootloader will switch to the other bank on next boot
     ota_set_flags_flash_mode_flag(FLASH_MODE_FLAG_FLASHED);
     ota_set_flags_boot_reason_code(REASON_NORMAL);
     ota_save_eeprom_flags();
 
+    // The update is done, go back to the idle connection parameters
+    ota_link_session_end();
+
     // Schedule an asynchronous reboot operation
     return ota_start_async_reboot();
 }
 
+bStatus_t ota_cmd_do_progress(uint8_t *buffer, uint32_t *buffer_length) {
+    const ota_progress_map_t *map = ota_progress_get_map();
+
+    if (*buffer_length < sizeof(ota_progress_map_t)) {
+        return ATT_ERR_INSUFFICIENT_RESOURCES; // Should not happen, the IO buffer holds the whole map
+    }
+
+    // Return the progress map in the IO buffer
+    tmos_memcpy(buffer, map, sizeof(ota_progress_map_t));
+    *buffer_length = sizeof(ota_progress_map_t);
+
+    return SUCCESS;
+}
+
+bStatus_t ota_cmd_do_progress_verified(ota_cmd_args_erase_t *args) {
+    // Only the flash bank that is not currently active is tracked
+    bStatus_t status;
+    status = ota_cmd_address_length_check(
+        args->address, 
+        args->length, 
+        ota_get_flags_current_flash_bank() == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A
+    );
+
+    if (status != SUCCESS) {
+        return status; // Address or length check failed
+    }
+
+    ota_progress_mark_verified(args->address, args->length);
+    return SUCCESS;
+}
+
+bStatus_t ota_cmd_do_stream_begin(ota_cmd_args_stream_t *args) {
+    // Stream can only be used to program the flash bank that is not currently active
+    bStatus_t status;
+    status = ota_cmd_address_length_check(
+        args->address, 
+        args->length, 
+        ota_get_flags_current_flash_bank() == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A
+    );
+
+    if (status != SUCCESS) {
+        return status; // Address or length check failed
+    }
+    if ((args->address & 0x03) != 0 || (args->length & 0x03) != 0) {
+        return bleInvalidRange; // Flash programming works on whole words
+    }
+
+    // (Re)open the stream, any previous stream is discarded
+    // The running CRC of programmed data covers the stream from here on
+    ota_async_event_reset_program_crc();
+    stream_active = 1;
+    stream_cursor = args->address;
+    stream_end = args->address + args->length;
+
+    return SUCCESS;
+}
+
+bStatus_t ota_cmd_do_stream_end(uint32_t expected_crc) {
+    if (!stream_active) {
+        return bleIncorrectMode; // No stream is open
+    }
+
+    // Close the stream in any case, the host has to start over if data is missing
+    // No chunk can be queued here, commands are only accepted while the engine is idle
+    stream_active = 0;
+    if (stream_cursor != stream_end) {
+        return ATT_ERR_INVALID_VALUE_SIZE; // Stream closed before all data was received
+    }
+    // Stream writes are not authenticated, the CRC of what actually went to flash has to match the host's
+    if (ota_async_event_program_crc() != expected_crc) {
+        return OTA_STATUS_CRC_MISMATCH;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Derive a new session key from the challenge and the host nonce
+ * Must only be called for a SESSION_BEGIN command authenticated with the challenge.
+ * 
+ * @param nonce Pointer to the 16-byte host nonce
+ * @param challenge Pointer to the 16-byte challenge the command was authenticated with
+ * 
+ * @return bStatus_t Result of the session setup
+ */
+bStatus_t ota_cmd_do_session_begin(const uint8_t *nonce, const uint8_t *challenge) {
+    // session_key = AES-CMAC(ota_aes128_key, challenge || nonce)
+    ota_cmd_prepare_key_ctx();
+    aes_cmac_init(&aes_cmac_ctx, &ota_aes128_key_ctx);
+    aes_cmac_update(&aes_cmac_ctx, challenge, 16);
+    aes_cmac_update(&aes_cmac_ctx, nonce, OTA_CMD_ARGS_SESSION_BEGIN_LEN);
+    aes_cmac_final(&aes_cmac_ctx, (uint8_t *)session_mac_buffer);
+
+    // Subkeys of the session key are generated once here, not per command
+    aes_cmac_key_init(&session_key_ctx, (uint8_t *)session_mac_buffer);
+    tmos_memset(session_mac_buffer, 0, sizeof(session_mac_buffer));
+    session_counter = 0;
+    session_active = 1;
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Drop the session key, e.g. when the connection drops
+ */
+void ota_cmd_session_end(void) {
+    session_active = 0;
+    session_counter = 0;
+    tmos_memset(&session_key_ctx, 0, sizeof(session_key_ctx));
+}
+
+/**
+ * @brief Check if a streaming program session is open
+ * 
+ * @return uint32_t 1 if a stream is open, 0 otherwise
+ */
+uint32_t ota_cmd_is_streaming(void) {
+    return stream_active;
+}
+
+/**
+ * @brief Get the flash address where the next stream write will be programmed
+ * 
+ * @return uint32_t Current stream cursor, 0 if no stream is open
+ */
+uint32_t ota_cmd_get_stream_cursor(void) {
+    return stream_active ? stream_cursor : 0;
+}
+
+/**
+ * @brief Get the number of stream bytes not handed to the OTA engine yet
+ * 
+ * @return uint32_t Bytes left until the end of the stream, 0 if no stream is open
+ */
+uint32_t ota_cmd_get_stream_remaining(void) {
+    return stream_active ? stream_end - stream_cursor : 0;
+}
+
+/**
+ * @brief Program a chunk of stream data at the stream cursor and advance the cursor
+ * The stream range has already been checked and authenticated by STREAM_BEGIN.
+ * 
+ * @param data Pointer to the chunk data (must be aligned)
+ * @param length Length of the chunk data, must be a multiple of 4
+ * 
+ * @return bStatus_t Result of the programming
+ */
+bStatus_t ota_cmd_stream_write(const uint8_t *data, uint32_t length) {
+    bStatus_t status;
+
+    if (!stream_active) {
+        return bleIncorrectMode; // No stream is open
+    }
+    if (length == 0 || (length & 0x03) != 0) {
+        return ATT_ERR_INVALID_VALUE_SIZE; // Flash programming works on whole words
+    }
+    if (length > stream_end - stream_cursor) {
+        return bleInvalidRange; // Chunk exceeds the announced stream length
+    }
+    ota_link_session_activity(); // Chunks may come over bulk data without any OTA command in between
+
+    if (ota_is_busy_flag()) {
+        if (stream_pending_data != NULL) {
+            return ATT_ERR_WRITE_NOT_PERMITTED; // Only one chunk can wait behind the running one
+        }
+        // Queue the chunk, it is started when the running chunk completes
+        stream_pending_data = data;
+        stream_pending_address = stream_cursor;
+        stream_pending_length = length;
+        stream_cursor += length;
+        async_opcode = OTA_CMD_OPCODE_STREAM_BEGIN; // Chunks never pass through ota_cmd_handler
+        return SUCCESS;
+    }
+
+    // Schedule an asynchronous program operation, a failure drops the stream in ota_cmd_async_complete
+    status = ota_start_async_program(stream_cursor, data, length);
+    if (status != SUCCESS) {
+        return status;
+    }
+
+    stream_cursor += length;
+    async_opcode = OTA_CMD_OPCODE_STREAM_BEGIN; // Chunks never pass through ota_cmd_handler
+    return SUCCESS;
+}
+
+/**
+ * @brief Get the IO buffer holding the queued stream chunk
+ * 
+ * @return const uint8_t* Buffer of the queued chunk, NULL if no chunk is queued
+ */
+const uint8_t *ota_cmd_stream_pending_buffer(void) {
+    return stream_pending_data;
+}
+
+/**
+ * @brief Follow up on a completed asynchronous operation
+ * 
+ * @param status Result of the operation
+ */
+void ota_cmd_async_complete(bStatus_t status) {
+    const uint8_t *data = stream_pending_data;
+    const uint8_t *result = NULL;
+    uint32_t result_length = 0;
+    uint32_t erase_skipped;
+
+    stream_pending_data = NULL;
+    if (stream_active && status != SUCCESS) {
+        // Flash content behind the cursor is unknown now, drop the stream and the queued chunk
+        stream_active = 0;
+    } else if (stream_active && data != NULL) {
+        // Start the queued chunk, the IO buffer of the completed chunk is free again
+        status = ota_start_async_program(stream_pending_address, data, stream_pending_length);
+        if (status == SUCCESS) {
+            OTAProfile_BulkResume(); // The IO buffer of the completed chunk is free for bulk data
+            return; // Still busy, the host is notified when the queued chunk completes
+        }
+        stream_active = 0;
+    }
+
+    // ERASE carries its skipped block count, the verify commands the result they left in the IO buffer
+    if (status == SUCCESS && async_opcode == OTA_CMD_OPCODE_ERASE) {
+        erase_skipped = ota_async_event_erase_skipped();
+        result = (const uint8_t *)&erase_skipped;
+        result_length = sizeof(uint32_t);
+    } else if (status == SUCCESS &&
+               (async_opcode == OTA_CMD_OPCODE_VERIFY || async_opcode == OTA_CMD_OPCODE_VERIFY_PAGES ||
+                async_opcode == OTA_CMD_OPCODE_VERIFY_CRC)) {
+        result = ota_async_event_result(&result_length);
+    }
+    ota_progress_flush(); // Completed pages are saved once per idle period, not per program operation
+    OTAProfile_NotifyComplete(async_opcode, status, result, result_length);
+    OTAProfile_BulkResume();
+}
+
+/**
+ * @brief Abort the open stream, e.g. when the connection drops
+ */
+void ota_cmd_stream_abort(void) {
+    stream_active = 0;
+    stream_pending_data = NULL;
+}
+
+/**
+ * @brief Check the target range of a batch sub-command
+ * Same checks as the sub-command runs itself, done up front so a bad entry never leaves earlier ones applied.
+ * 
+ * @param entry Pointer to the sub-command entry header
+ * 
+ * @return bStatus_t Result of the check
+ */
+static bStatus_t ota_cmd_batch_entry_check(const ota_cmd_batch_entry_t *entry) {
+    current_flash_bank_t target_bank = ota_get_flags_current_flash_bank() == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A;
+    bStatus_t status;
+
+    switch (entry->opcode) {
+        case OTA_CMD_OPCODE_PROGRAM:
+            if (stream_active) {
+                return bleIncorrectMode; // IO buffer writes belong to the open stream
+            }
+            if ((entry->address & 0x03) != 0) {
+                return bleInvalidRange; // Flash is compared and programmed word by word
+            }
+            return ota_cmd_address_length_check(entry->address, entry->data_length, target_bank);
+        case OTA_CMD_OPCODE_ERASE:
+            return ota_cmd_address_length_check(entry->address, entry->length, target_bank);
+        default:
+            // Verify works on either bank
+            status = ota_cmd_address_length_check(entry->address, entry->length, FLASH_BANK_A);
+            if (status != SUCCESS) {
+                status = ota_cmd_address_length_check(entry->address, entry->length, FLASH_BANK_B);
+            }
+            return status;
+    }
+}
+
+/**
+ * @brief Validate a batch sub-command list and start executing it
+ * Every entry, including its address range, is checked before anything runs.
+ * 
+ * @param io_buffer Pointer to the IO buffer holding the packed sub-command list
+ * @param io_buffer_length Pointer to the length of the IO buffer
+ * 
+ * @return bStatus_t Result of the validation
+ */
+bStatus_t ota_cmd_do_batch(const uint8_t *io_buffer, uint32_t *io_buffer_length) {
+    ota_cmd_batch_entry_t entry;
+    bStatus_t status;
+    uint32_t offset = 0;
+    uint32_t count = 0;
+    uint32_t length = *io_buffer_length;
+
+    if (length == 0 || length > sizeof(batch_buffer)) {
+        return ATT_ERR_INVALID_VALUE_SIZE; // Empty or oversized sub-command list
+    }
+
+    while (offset < length) {
+        if (length - offset < sizeof(ota_cmd_batch_entry_t)) {
+            return ATT_ERR_INVALID_VALUE_SIZE; // Truncated entry header
+        }
+        tmos_memcpy(&entry, io_buffer + offset, sizeof(ota_cmd_batch_entry_t));
+        if (entry.reserved != 0) {
+            return ATT_ERR_INVALID_VALUE;
+        }
+        switch (entry.opcode) {
+            case OTA_CMD_OPCODE_PROGRAM:
+                if (entry.data_length == 0 || (entry.data_length & 0x03) != 0) {
+                    return ATT_ERR_INVALID_VALUE_SIZE; // Flash programming works on whole words
+                }
+                break;
+            case OTA_CMD_OPCODE_ERASE:
+            case OTA_CMD_OPCODE_VERIFY:
+                if (entry.data_length != 0) {
+                    return ATT_ERR_INVALID_VALUE_SIZE; // Only PROGRAM carries inline data
+                }
+                break;
+            default:
+                return ATT_ERR_INVALID_VALUE; // Sub-command not allowed in a batch
+        }
+        status = ota_cmd_batch_entry_check(&entry);
+        if (status != SUCCESS) {
+            return status;
+        }
+        offset += sizeof(ota_cmd_batch_entry_t);
+        if (entry.data_length > length - offset) {
+            return ATT_ERR_INVALID_VALUE_SIZE; // Inline data exceeds the list
+        }
+        offset += entry.data_length;
+        if (++count > 0xFF) {
+            return ATT_ERR_INVALID_VALUE_SIZE; // Index must fit in the status readback
+        }
+    }
+
+    tmos_memcpy(batch_buffer, io_buffer, length);
+    batch_length = length;
+    batch_offset = 0;
+    batch_index = 0;
+    batch_io_buffer = (uint8_t *)io_buffer;
+    batch_io_buffer_length = io_buffer_length;
+
+    // Schedule the asynchronous batch execution
+    return ota_start_async_batch();
+}
+
 /**
  * @brief OTA command dispatcher
  * This function dispatches the OTA command based on the opcode in the buffer.
@@ -339,8 +1034,12 @@ bStatus_t ota_cmd_dispatcher(
     union {
         ota_cmd_args_read_t read_args;
         ota_cmd_args_program_t program_args;
+        ota_cmd_args_program_compressed_t program_compressed_args;
+        ota_cmd_args_patch_t patch_args;
         ota_cmd_args_erase_t erase_args;
         ota_cmd_args_verify_t verify_args;
+        ota_cmd_args_stream_t stream_args;
+        uint32_t expected_crc;
     } args;
 
     uint32_t new_length = OTA_IO_BUFFER_SIZE;
@@ -365,6 +1064,20 @@ bStatus_t ota_cmd_dispatcher(
             args.program_args.data = (uint8_t *)io_buffer; // Use the IO buffer for program data
             args.program_args.length = *io_buffer_length; // Length of data to program is the IO buffer length
             return ota_cmd_do_program(&args.program_args); // Call the program command handler
+        case OTA_CMD_OPCODE_PROGRAM_COMPRESSED:
+            // Program compressed command
+            tmos_memcpy(&args.program_compressed_args.address, buffer + 1, sizeof(uint32_t));
+            tmos_memcpy(&args.program_compressed_args.length, buffer + 1 + sizeof(uint32_t), sizeof(uint32_t));
+            args.program_compressed_args.data = (uint8_t *)io_buffer; // Use the IO buffer for compressed data
+            args.program_compressed_args.data_length = *io_buffer_length; // Length of compressed data is the IO buffer length
+            return ota_cmd_do_program_compressed(&args.program_compressed_args); // Call the program compressed command handler
+        case OTA_CMD_OPCODE_PATCH:
+            // Patch command
+            tmos_memcpy(&args.patch_args.address, buffer + 1, sizeof(uint32_t));
+            tmos_memcpy(&args.patch_args.length, buffer + 1 + sizeof(uint32_t), sizeof(uint32_t));
+            args.patch_args.patch = (uint8_t *)io_buffer; // Use the IO buffer for patch instructions
+            args.patch_args.patch_length = *io_buffer_length; // Length of patch instructions is the IO buffer length
+            return ota_cmd_do_patch(&args.patch_args); // Call the patch command handler
         case OTA_CMD_OPCODE_ERASE: 
             // Erase command
             tmos_memcpy(&args.erase_args.address, buffer + 1, sizeof(uint32_t));
@@ -378,12 +1091,62 @@ bStatus_t ota_cmd_dispatcher(
             args.verify_args.result_length = io_buffer_length; // Length of the result buffer is the IO buffer length
             status = ota_cmd_do_verify(&args.verify_args); // Call the verify command handler
             return status;
+        case OTA_CMD_OPCODE_VERIFY_CRC:
+            // Verify CRC command
+            tmos_memcpy(&args.verify_args.address, buffer + 1, sizeof(uint32_t));
+            tmos_memcpy(&args.verify_args.length, buffer + 1 + sizeof(uint32_t), sizeof(uint32_t));
+            args.verify_args.result = (uint8_t *)io_buffer; // Use the IO buffer for the CRC
+            args.verify_args.result_length = io_buffer_length; // Length of the result buffer is the IO buffer length
+            return ota_cmd_do_verify_crc(&args.verify_args); // Call the verify CRC command handler
+        case OTA_CMD_OPCODE_VERIFY_PAGES:
+            // Verify pages command
+            tmos_memcpy(&args.verify_args.address, buffer + 1, sizeof(uint32_t));
+            tmos_memcpy(&args.verify_args.length, buffer + 1 + sizeof(uint32_t), sizeof(uint32_t));
+            args.verify_args.result = (uint8_t *)io_buffer; // Use the IO buffer for the digests
+            args.verify_args.result_length = io_buffer_length; // Length of the result buffer is the IO buffer length
+            return ota_cmd_do_verify_pages(&args.verify_args); // Call the verify pages command handler
         case OTA_CMD_OPCODE_REBOOT:
             // Reboot command
             return ota_cmd_do_reboot(); // Call the reboot command handler
         case OTA_CMD_OPCODE_CONFIRM:
             // Confirm command
             return ota_cmd_do_confirm(); // Call the confirm command handler
+        case OTA_CMD_OPCODE_STREAM_BEGIN:
+            // Stream begin command
+            tmos_memcpy(&args.stream_args.address, buffer + 1, sizeof(uint32_t));
+            tmos_memcpy(&args.stream_args.length, buffer + 1 + sizeof(uint32_t), sizeof(uint32_t));
+            return ota_cmd_do_stream_begin(&args.stream_args); // Call the stream begin command handler
+        case OTA_CMD_OPCODE_STREAM_END:
+            // Stream end command
+            tmos_memcpy(&args.expected_crc, buffer + 1, sizeof(uint32_t));
+            return ota_cmd_do_stream_end(args.expected_crc); // Call the stream end command handler
+        case OTA_CMD_OPCODE_PROGRESS:
+            // Progress command
+            status = ota_cmd_do_progress((uint8_t *)io_buffer, &new_length); // Call the progress command handler
+            if(status == SUCCESS) {
+                *io_buffer_length = new_length;
+            }
+            return status;
+        case OTA_CMD_OPCODE_DIGEST_BEGIN:
+            // Digest begin command, same arguments as erase plus the expected digest in the IO buffer
+            tmos_memcpy(&args.erase_args.address, buffer + 1, sizeof(uint32_t));
+            tmos_memcpy(&args.erase_args.length, buffer + 1 + sizeof(uint32_t), sizeof(uint32_t));
+            return ota_cmd_do_digest_begin(&args.erase_args, io_buffer, *io_buffer_length); // Call the digest begin command handler
+        case OTA_CMD_OPCODE_DIGEST_STATUS:
+            // Digest status command
+            status = ota_cmd_do_digest_status((uint8_t *)io_buffer, &new_length); // Call the digest status command handler
+            if(status == SUCCESS) {
+                *io_buffer_length = new_length;
+            }
+            return status;
+        case OTA_CMD_OPCODE_PROGRESS_VERIFIED:
+            // Progress verified command, same arguments as erase
+            tmos_memcpy(&args.erase_args.address, buffer + 1, sizeof(uint32_t));
+            tmos_memcpy(&args.erase_args.length, buffer + 1 + sizeof(uint32_t), sizeof(uint32_t));
+            return ota_cmd_do_progress_verified(&args.erase_args); // Call the progress verified command handler
+        case OTA_CMD_OPCODE_BATCH:
+            // Batch command
+            return ota_cmd_do_batch(io_buffer, io_buffer_length); // Call the batch command handler
         default:
             // Unknown command opcode
             // Should not happen if the command has been validated before
@@ -391,6 +1154,90 @@ bStatus_t ota_cmd_dispatcher(
     }
 }
 
+/**
+ * @brief Check if the running batch has sub-commands left
+ * 
+ * @return uint32_t 1 if there is a next sub-command, 0 otherwise
+ */
+uint32_t ota_cmd_batch_has_next(void) {
+    return batch_offset < batch_length;
+}
+
+/**
+ * @brief Dispatch the next sub-command of the running batch
+ * 
+ * @return bStatus_t SUCCESS if the sub-command completed, blePending if it continues asynchronously,
+ *                   or the error of the failing sub-command
+ */
+bStatus_t ota_cmd_batch_step(void) {
+    ota_cmd_batch_entry_t entry;
+    uint8_t cmd[OTA_CMD_ARGS_ERASE_LEN + sizeof(uint8_t)];
+    uint32_t data_length;
+    bStatus_t status;
+
+    // Entry has already been validated by ota_cmd_do_batch
+    tmos_memcpy(&entry, batch_buffer + batch_offset, sizeof(ota_cmd_batch_entry_t));
+    batch_index = (batch_offset == 0) ? 0 : batch_index + 1;
+    batch_offset += sizeof(ota_cmd_batch_entry_t);
+
+    // Rebuild the sub-command in the MAIN command layout: opcode, address, length
+    cmd[0] = entry.opcode;
+    tmos_memcpy(cmd + 1, &entry.address, sizeof(uint32_t));
+    tmos_memcpy(cmd + 1 + sizeof(uint32_t), &entry.length, sizeof(uint32_t));
+
+    switch (entry.opcode) {
+        case OTA_CMD_OPCODE_PROGRAM:
+            // Program data is inline, right after the entry header
+            data_length = entry.data_length;
+            status = ota_cmd_dispatcher(cmd, sizeof(cmd), batch_buffer + batch_offset, &data_length);
+            batch_offset += entry.data_length;
+            return status == SUCCESS ? blePending : status;
+        case OTA_CMD_OPCODE_ERASE:
+        case OTA_CMD_OPCODE_VERIFY:
+            // Verification result goes to the IO buffer, so the host can read it after the batch
+            status = ota_cmd_dispatcher(cmd, sizeof(cmd), batch_io_buffer, batch_io_buffer_length);
+            return status == SUCCESS ? blePending : status;
+        default:
+            // Should not happen, the list has been validated before
+            return ATT_ERR_UNSUPPORTED_REQ;
+    }
+}
+
+/**
+ * @brief Get the index of the batch sub-command that ran last
+ * If the batch failed, this is the index of the failing sub-command.
+ * 
+ * @return uint8_t Index of the sub-command in the batch list
+ */
+uint8_t ota_cmd_get_batch_index(void) {
+    return batch_index;
+}
+
+/**
+ * @brief Dispatch an authenticated OTA command and remember it if it runs asynchronously
+ * The opcode is only taken over once the command has been accepted, so a synchronous command
+ * never shows up in the completion notification of an asynchronous one.
+ * 
+ * @param buffer Pointer to the buffer containing the OTA command, without the session trailer
+ * @param length Length of the OTA command in the buffer
+ * @param io_buffer Pointer to the IO buffer where the command data is stored
+ * @param io_buffer_length Pointer to the length of the IO buffer
+ * 
+ * @return bStatus_t Result of the command dispatching
+ */
+static bStatus_t ota_cmd_dispatch_command(
+    const uint8_t *buffer,
+    uint32_t length,
+    const uint8_t *io_buffer,
+    uint32_t *io_buffer_length
+) {
+    bStatus_t status = ota_cmd_dispatcher(buffer, length, io_buffer, io_buffer_length);
+    if (status == SUCCESS && ota_is_busy_flag()) {
+        async_opcode = buffer[0];
+    }
+    return status;
+}
+
 /**
  * @brief OTA command handler
  * This function handles the OTA command by validating, authenticating, and dispatching it.
@@ -423,11 +1270,35 @@ bStatus_t ota_cmd_handler(
     }
 
     // Step 2: Authenticate the OTA command
+    if (buffer[0] & OTA_CMD_SESSION_FLAG) {
+        status = ota_cmd_is_session_authenticated(buffer, length, io_buffer, *io_buffer_length);
+        if (status != SUCCESS) {
+            return status; // Authentication failed
+        }
+        if ((buffer[0] & ~OTA_CMD_SESSION_FLAG) != OTA_CMD_OPCODE_CONFIRM) {
+            ota_link_session_activity(); // CONFIRM ends the session, it only asks for the idle parameters
+        }
+
+        // Strip the session flag, counter and tag before dispatching
+        length -= OTA_CMD_SESSION_TRAILER_LEN;
+        tmos_memcpy(aes_cmac_temp_cmd_buffer, buffer, length);
+        aes_cmac_temp_cmd_buffer[0] &= ~OTA_CMD_SESSION_FLAG;
+        return ota_cmd_dispatch_command((const uint8_t *)aes_cmac_temp_cmd_buffer, length, io_buffer, io_buffer_length);
+    }
+
     status = ota_cmd_is_authenticated(buffer, length, io_buffer, *io_buffer_length, challenge, challenge_length, token, token_length);
     if (status != SUCCESS) {
         return status; // Authentication failed
     }
+    if (buffer[0] != OTA_CMD_OPCODE_CONFIRM) {
+        ota_link_session_activity(); // CONFIRM ends the session, it only asks for the idle parameters
+    }
+
+    // Session begin needs the challenge, so it is handled here instead of in the dispatcher
+    if (buffer[0] == OTA_CMD_OPCODE_SESSION_BEGIN) {
+        return ota_cmd_do_session_begin(buffer + 1, challenge);
+    }
 
     // Step 3: Dispatch the OTA command
-    return ota_cmd_dispatcher(buffer, length, io_buffer, io_buffer_length);
+    return ota_cmd_dispatch_command(buffer, length, io_buffer, io_buffer_length);
 }
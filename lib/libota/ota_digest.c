@@ -0,0 +1,133 @@
+// ota_digest.c
+// This file contains the implementation of the running SHA256 digest of sequentially programmed data.
+// The digest of a range is known right after its last byte has been programmed, without reading the bank again.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ota_digest.h"
+#include "ota_cmd.h"
+#include "ota_progress.h"
+#include "sha256_impl.h"
+
+// Stupid WCH implemented a fully wrong memcmp function, see ota_cmd.c
+#define mem_equal tmos_memcmp
+
+static ota_digest_state_t digest_state = OTA_DIGEST_STATE_IDLE;
+static uint32_t digest_start, digest_next, digest_end;
+static uint32_t digest_has_expected = 0;
+static SHA256_CTX digest_ctx;
+__attribute__((aligned(8))) static uint8_t digest_expected[32];
+__attribute__((aligned(8))) static uint8_t digest_result[32];
+
+/**
+ * @brief Start a running digest over a range
+ * Any previous running digest is discarded.
+ * 
+ * @param address Start address of the range
+ * @param length Length of the range
+ * @param expected Pointer to the expected 32-byte SHA256 digest, NULL to only compute it
+ */
+void ota_digest_begin(uint32_t address, uint32_t length, const uint8_t *expected)
+{
+    digest_start = address;
+    digest_next = address;
+    digest_end = address + length;
+    digest_has_expected = expected != NULL;
+    if (expected != NULL)
+    {
+        tmos_memcpy(digest_expected, expected, sizeof(digest_expected));
+    }
+    tmos_memset(digest_result, 0, sizeof(digest_result));
+    sha256_init(&digest_ctx);
+    digest_state = OTA_DIGEST_STATE_RUNNING;
+}
+
+/**
+ * @brief Add programmed data to the running digest
+ * Data must be programmed front to back, anything else inside the range breaks the digest.
+ * 
+ * @param address Flash address of the programmed data, read back in place from the mapped flash
+ * @param length Length of the programmed data
+ * 
+ * @return bStatus_t OTA_STATUS_DIGEST_MISMATCH if the data completes the range and does not match, SUCCESS otherwise
+ */
+bStatus_t ota_digest_update(uint32_t address, uint32_t length)
+{
+    if (digest_state != OTA_DIGEST_STATE_RUNNING)
+    {
+        return SUCCESS;
+    }
+    if (address + length <= digest_start || address >= digest_end)
+    {
+        return SUCCESS; // Outside of the range
+    }
+    if (address != digest_next || length > digest_end - digest_next)
+    {
+        digest_state = OTA_DIGEST_STATE_BROKEN; // Out of order or crossing the end of the range
+        return SUCCESS;
+    }
+
+    // Code flash is memory mapped, the data is hashed as it has been written
+    sha256_update(&digest_ctx, (const uint8_t *)(uintptr_t)address, length);
+    digest_next += length;
+    if (digest_next != digest_end)
+    {
+        return SUCCESS;
+    }
+
+    sha256_final(&digest_ctx, digest_result);
+    if (!digest_has_expected)
+    {
+        digest_state = OTA_DIGEST_STATE_DONE;
+        return SUCCESS;
+    }
+    if (mem_equal(digest_result, digest_expected, sizeof(digest_result)) == 0)
+    {
+        digest_state = OTA_DIGEST_STATE_MISMATCH;
+        return OTA_STATUS_DIGEST_MISMATCH;
+    }
+
+    // The range is verified now, no separate VERIFY pass is needed
+    digest_state = OTA_DIGEST_STATE_MATCH;
+    ota_progress_mark_verified(digest_start, digest_end - digest_start);
+    return SUCCESS;
+}
+
+/**
+ * @brief Drop the digest if an erase hits data that has already been hashed
+ * Erasing ahead of the digest, e.g. the next page to program, is fine.
+ * 
+ * @param address Start address of the erased range
+ * @param length Length of the erased range
+ */
+void ota_digest_erased(uint32_t address, uint32_t length)
+{
+    if (digest_state == OTA_DIGEST_STATE_IDLE || digest_state == OTA_DIGEST_STATE_BROKEN)
+    {
+        return;
+    }
+    if (address < digest_next && address + length > digest_start)
+    {
+        digest_state = OTA_DIGEST_STATE_BROKEN;
+    }
+}
+
+/**
+ * @brief Get the state of the running digest
+ * 
+ * @return ota_digest_state_t State of the running digest
+ */
+ota_digest_state_t ota_digest_get_state(void)
+{
+    return digest_state;
+}
+
+/**
+ * @brief Get the digest of the range
+ * 
+ * @return const uint8_t* Pointer to the 32-byte SHA256 digest, all zero until the range is programmed
+ */
+const uint8_t *ota_digest_get_result(void)
+{
+    return digest_result;
+}
@@ -7,6 +7,8 @@
 #include "eeprom_flags.h"
 #include "ota_async_event.h"
 #include "ota_cmd.h"
+#include "crc32_impl.h"
+#include "ota_link.h"
 
 // GATT Profile Service UUID
 const uint8_t otaProfileServiceUUID[ATT_BT_UUID_SIZE] = {
@@ -14,65 +16,82 @@ const uint8_t otaProfileServiceUUID[ATT_BT_UUID_SIZE] = {
     HI_UINT16(OTA_GATT_PROFILE_SERV_UUID)
 };
 
-// Characteristic 1 UUID
-const uint8_t otaProfileChar1UUID[ATT_BT_UUID_SIZE] = {
-    LO_UINT16(OTA_GATT_PROFILE_CHAR_UUID_MAIN),
-    HI_UINT16(OTA_GATT_PROFILE_CHAR_UUID_MAIN)
-};
-
-// Characteristic 2 UUID
-const uint8_t otaProfileChar2UUID[ATT_BT_UUID_SIZE] = {
-    LO_UINT16(OTA_GATT_PROFILE_CHAR_UUID_BUFFER),
-    HI_UINT16(OTA_GATT_PROFILE_CHAR_UUID_BUFFER)
-};
-
-// Characteristic 3 UUID
-const uint8_t otaProfileChar3UUID[ATT_BT_UUID_SIZE] = {
-    LO_UINT16(OTA_GATT_PROFILE_CHAR_UUID_CHALLENGE),
-    HI_UINT16(OTA_GATT_PROFILE_CHAR_UUID_CHALLENGE)
-};
-
-// Characteristic 4 UUID
-const uint8_t otaProfileChar4UUID[ATT_BT_UUID_SIZE] = {
-    LO_UINT16(OTA_GATT_PROFILE_CHAR_UUID_TOKEN),
-    HI_UINT16(OTA_GATT_PROFILE_CHAR_UUID_TOKEN)
-};
-
-// Characteristic 5 UUID
-const uint8_t otaProfileChar5UUID[ATT_BT_UUID_SIZE] = {
-    LO_UINT16(OTA_GATT_PROFILE_CHAR_UUID_FLASH_BANK),
-    HI_UINT16(OTA_GATT_PROFILE_CHAR_UUID_FLASH_BANK)
-};
-
-// Characteristic 6 UUID
-const uint8_t otaProfileChar6UUID[ATT_BT_UUID_SIZE] = {
-    LO_UINT16(OTA_GATT_PROFILE_CHAR_UUID_FLASH_BANK_READABLE),
-    HI_UINT16(OTA_GATT_PROFILE_CHAR_UUID_FLASH_BANK_READABLE)
+// OTA GATT Profile Characteristics, one entry each
+// CHAR(n, uuid, properties, value permissions, value, user description, read handler, write handler)
+// Every characteristic gets a declaration, a value and a user description attribute.
+// CHAR_NOTIFY characteristics also get a client characteristic configuration after the value,
+// held in otaProfileChar<n>Config.
+// Callbacks are dispatched by attribute index, a NULL handler means the value cannot be read or written.
+#define OTA_PROFILE_CHAR_LIST(CHAR, CHAR_NOTIFY) \
+    CHAR_NOTIFY(1, OTA_GATT_PROFILE_CHAR_UUID_MAIN, \
+        GATT_PROP_READ | GATT_PROP_WRITE | GATT_PROP_WRITE_NO_RSP | GATT_PROP_NOTIFY, GATT_PERMIT_READ | GATT_PERMIT_WRITE, \
+        NULL, "OTA Command Control & Status Readback", OTAProfile_ReadMain, OTAProfile_WriteMain) \
+    CHAR(2, OTA_GATT_PROFILE_CHAR_UUID_BUFFER, \
+        GATT_PROP_READ | GATT_PROP_WRITE | GATT_PROP_WRITE_NO_RSP, GATT_PERMIT_READ | GATT_PERMIT_WRITE, \
+        otaProfileChar2Val, "OTA Buffer", OTAProfile_ReadBuffer, OTAProfile_WriteBuffer) \
+    CHAR(3, OTA_GATT_PROFILE_CHAR_UUID_CHALLENGE, \
+        GATT_PROP_READ, GATT_PERMIT_READ | GATT_PERMIT_WRITE, \
+        otaProfileChar3Val, "OTA AES-CMAC Signature Challenge", OTAProfile_ReadChallenge, NULL) \
+    CHAR(4, OTA_GATT_PROFILE_CHAR_UUID_TOKEN, \
+        GATT_PROP_READ | GATT_PROP_WRITE | GATT_PROP_WRITE_NO_RSP, GATT_PERMIT_READ | GATT_PERMIT_WRITE, \
+        otaProfileChar4Val, "OTA AES-CMAC Signature Token", OTAProfile_ReadToken, OTAProfile_WriteToken) \
+    CHAR(5, OTA_GATT_PROFILE_CHAR_UUID_FLASH_BANK, \
+        GATT_PROP_READ, GATT_PERMIT_READ, \
+        NULL, "OTA Flash Bank", OTAProfile_ReadFlashBank, NULL) \
+    CHAR(6, OTA_GATT_PROFILE_CHAR_UUID_FLASH_BANK_READABLE, \
+        GATT_PROP_READ, GATT_PERMIT_READ, \
+        NULL, "OTA Flash Bank (Readable String)", OTAProfile_ReadFlashBankString, NULL) \
+    CHAR(7, OTA_GATT_PROFILE_CHAR_UUID_FLASH_MODE, \
+        GATT_PROP_READ, GATT_PERMIT_READ, \
+        NULL, "OTA Flash Mode", OTAProfile_ReadFlashMode, NULL) \
+    CHAR(8, OTA_GATT_PROFILE_CHAR_UUID_FLASH_MODE_READABLE, \
+        GATT_PROP_READ, GATT_PERMIT_READ, \
+        NULL, "OTA Flash Mode (Readable String)", OTAProfile_ReadFlashModeString, NULL) \
+    CHAR(9, OTA_GATT_PROFILE_CHAR_UUID_BOOT_REASON, \
+        GATT_PROP_READ, GATT_PERMIT_READ, \
+        NULL, "OTA Boot Reason", OTAProfile_ReadBootReason, NULL) \
+    CHAR(10, OTA_GATT_PROFILE_CHAR_UUID_BOOT_REASON_READABLE, \
+        GATT_PROP_READ, GATT_PERMIT_READ, \
+        NULL, "OTA Boot Reason (Readable String)", OTAProfile_ReadBootReasonString, NULL) \
+    CHAR_NOTIFY(11, OTA_GATT_PROFILE_CHAR_UUID_BULK, \
+        GATT_PROP_READ | GATT_PROP_WRITE_NO_RSP | GATT_PROP_NOTIFY, GATT_PERMIT_READ | GATT_PERMIT_WRITE, \
+        NULL, "OTA Bulk Data", OTAProfile_ReadBulk, OTAProfile_WriteBulk) \
+    CHAR(12, OTA_GATT_PROFILE_CHAR_UUID_LINK, \
+        GATT_PROP_READ, GATT_PERMIT_READ, \
+        NULL, "OTA Link Payload", OTAProfile_ReadLink, NULL)
+
+// Attribute indexes, in table order
+#define OTA_PROFILE_CHAR_INDEXES(n, uuid, props, permit, value, desc, read, write) \
+    OTA_PROFILE_ATTR_CHAR##n##_DECL, \
+    OTA_PROFILE_ATTR_CHAR##n##_VALUE, \
+    OTA_PROFILE_ATTR_CHAR##n##_DESC,
+#define OTA_PROFILE_CHAR_NOTIFY_INDEXES(n, uuid, props, permit, value, desc, read, write) \
+    OTA_PROFILE_ATTR_CHAR##n##_DECL, \
+    OTA_PROFILE_ATTR_CHAR##n##_VALUE, \
+    OTA_PROFILE_ATTR_CHAR##n##_CONFIG, \
+    OTA_PROFILE_ATTR_CHAR##n##_DESC,
+
+enum
+{
+    OTA_PROFILE_ATTR_SERVICE = 0,
+    OTA_PROFILE_CHAR_LIST(OTA_PROFILE_CHAR_INDEXES, OTA_PROFILE_CHAR_NOTIFY_INDEXES)
+    OTA_PROFILE_ATTR_COUNT
 };
 
-// Characteristic 7 UUID
-const uint8_t otaProfileChar7UUID[ATT_BT_UUID_SIZE] = {
-    LO_UINT16(OTA_GATT_PROFILE_CHAR_UUID_FLASH_MODE),
-    HI_UINT16(OTA_GATT_PROFILE_CHAR_UUID_FLASH_MODE)
-};
+// Characteristic UUIDs
+#define OTA_PROFILE_CHAR_UUID(n, uuid, props, permit, value, desc, read, write) \
+    const uint8_t otaProfileChar##n##UUID[ATT_BT_UUID_SIZE] = { LO_UINT16(uuid), HI_UINT16(uuid) };
+OTA_PROFILE_CHAR_LIST(OTA_PROFILE_CHAR_UUID, OTA_PROFILE_CHAR_UUID)
 
-// Characteristic 8 UUID
-const uint8_t otaProfileChar8UUID[ATT_BT_UUID_SIZE] = {
-    LO_UINT16(OTA_GATT_PROFILE_CHAR_UUID_FLASH_MODE_READABLE),
-    HI_UINT16(OTA_GATT_PROFILE_CHAR_UUID_FLASH_MODE_READABLE)
-};
+// Characteristic Properties
+#define OTA_PROFILE_CHAR_PROPS(n, uuid, props, permit, value, desc, read, write) \
+    static uint8_t otaProfileChar##n##Props = props;
+OTA_PROFILE_CHAR_LIST(OTA_PROFILE_CHAR_PROPS, OTA_PROFILE_CHAR_PROPS)
 
-// Characteristic 9 UUID
-const uint8_t otaProfileChar9UUID[ATT_BT_UUID_SIZE] = {
-    LO_UINT16(OTA_GATT_PROFILE_CHAR_UUID_BOOT_REASON),
-    HI_UINT16(OTA_GATT_PROFILE_CHAR_UUID_BOOT_REASON)
-};
-
-// Characteristic 10 UUID
-const uint8_t otaProfileChar10UUID[ATT_BT_UUID_SIZE] = {
-    LO_UINT16(OTA_GATT_PROFILE_CHAR_UUID_BOOT_REASON_READABLE),
-    HI_UINT16(OTA_GATT_PROFILE_CHAR_UUID_BOOT_REASON_READABLE)
-};
+// Characteristic User Descriptions
+#define OTA_PROFILE_CHAR_USER_DESC(n, uuid, props, permit, value, desc, read, write) \
+    static uint8_t otaProfileChar##n##UserDesc[] = desc;
+OTA_PROFILE_CHAR_LIST(OTA_PROFILE_CHAR_USER_DESC, OTA_PROFILE_CHAR_USER_DESC)
 
 // GATT Profile Service attributes
 static const gattAttrType_t otaProfileService = {
@@ -80,390 +99,62 @@ static const gattAttrType_t otaProfileService = {
     .uuid = otaProfileServiceUUID
 };
 
-// Characteristic 1 Properties
-static uint8_t otaProfileChar1Props = GATT_PROP_READ | GATT_PROP_WRITE | GATT_PROP_WRITE_NO_RSP;
-
-// Characteristic 1 User Description
-static uint8_t otaProfileChar1UserDesc[] = "OTA Command Control & Status Readback";
+// Characteristic 1 Client Characteristic Configuration, enables the completion notifications
+static gattCharCfg_t otaProfileChar1Config[GATT_MAX_NUM_CONN];
 
-// Characteristic 2 Properties
-static uint8_t otaProfileChar2Props = GATT_PROP_READ | GATT_PROP_WRITE | GATT_PROP_WRITE_NO_RSP;
+// Connection that sent the last OTA command, completion notifications go there
+static uint16_t otaProfileCmdConnHandle = INVALID_CONNHANDLE;
 
 // Characteristic 2 Value
-__attribute__((aligned(8))) static uint8_t otaProfileChar2Val[OTA_IO_BUFFER_SIZE] = {0};
-static uint32_t otaProfileChar2Len = 0;
-
-// Characteristic 2 User Description
-static uint8_t otaProfileChar2UserDesc[] = "OTA Buffer";
-
-// Characteristic 3 Properties
-static uint8_t otaProfileChar3Props = GATT_PROP_READ;
+// Ping-pong pair of IO buffers: the host fills one while the other is still being programmed
+__attribute__((aligned(8))) static uint8_t otaProfileChar2Val[OTA_IO_BUFFER_COUNT][OTA_IO_BUFFER_SIZE] = {0};
+static uint32_t otaProfileChar2Len[OTA_IO_BUFFER_COUNT] = {0};
+static uint32_t otaProfileChar2Host = 0; // Index of the IO buffer the host reads and writes
 
 // Characteristic 3 Value
 static uint8_t otaProfileChar3Val[16] = {0};
 static const uint32_t otaProfileChar3Len = 16; // Fixed length for AES-CMAC challenge
 
-// Characteristic 3 User Description
-static uint8_t otaProfileChar3UserDesc[] = "OTA AES-CMAC Signature Challenge";
-
-// Characteristic 4 Properties
-static uint8_t otaProfileChar4Props = GATT_PROP_READ | GATT_PROP_WRITE | GATT_PROP_WRITE_NO_RSP;
-
 // Characteristic 4 Value
 static uint8_t otaProfileChar4Val[16] = {0};
 static uint32_t otaProfileChar4Len = 16;
 
-// Characteristic 4 User Description
-static uint8_t otaProfileChar4UserDesc[] = "OTA AES-CMAC Signature Token";
-
-// Characteristic 5 Properties
-static uint8_t otaProfileChar5Props = GATT_PROP_READ;
-
-// Characteristic 5 User Description
-static uint8_t otaProfileChar5UserDesc[] = "OTA Flash Bank";
-
-// Characteristic 6 Properties
-static uint8_t otaProfileChar6Props = GATT_PROP_READ;
-
-// Characteristic 6 User Description
-static uint8_t otaProfileChar6UserDesc[] = "OTA Flash Bank (Readable String)";
-
-// Characteristic 7 Properties
-static uint8_t otaProfileChar7Props = GATT_PROP_READ;
-
-// Characteristic 7 User Description
-static uint8_t otaProfileChar7UserDesc[] = "OTA Flash Mode";
-
-// Characteristic 8 Properties
-static uint8_t otaProfileChar8Props = GATT_PROP_READ;
+// Characteristic 11 State, payloads are written to the IO buffers
+static uint16_t otaProfileBulkNextSeq = 0;
+static uint8_t otaProfileBulkState = OTA_BULK_OK;
+static uint32_t otaProfileBulkCrc = CRC32_INIT;
 
-// Characteristic 8 User Description
-static uint8_t otaProfileChar8UserDesc[] = "OTA Flash Mode (Readable String)";
+// Characteristic 11 Client Characteristic Configuration, enables the resume notifications
+static gattCharCfg_t otaProfileChar11Config[GATT_MAX_NUM_CONN];
 
-// Characteristic 9 Properties
-static uint8_t otaProfileChar9Props = GATT_PROP_READ;
-
-// Characteristic 9 User Description
-static uint8_t otaProfileChar9UserDesc[] = "OTA Boot Reason";
-
-// Characteristic 10 Properties
-static uint8_t otaProfileChar10Props = GATT_PROP_READ;
-
-// Characteristic 10 User Description
-static uint8_t otaProfileChar10UserDesc[] = "OTA Boot Reason (Readable String)";
+// Connection that sent the last bulk data write, resume notifications go there
+static uint16_t otaProfileBulkConnHandle = INVALID_CONNHANDLE;
 
 // Profile Attributes Table
-static gattAttribute_t otaProfileAttrTbl[] = {
-    // Service Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = primaryServiceUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = (uint8_t *)&otaProfileService,
-    },
-    // Characteristic 1 Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = characterUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = &otaProfileChar1Props,
-    },
-    // Characteristic 1 Value
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = otaProfileChar1UUID,
-        },
-        .permissions = GATT_PERMIT_READ | GATT_PERMIT_WRITE,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = NULL, 
-    },
-    // Characteristic 1 User Description
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = charUserDescUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar1UserDesc,
-    },
-    // Characteristic 2 Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = characterUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = &otaProfileChar2Props,
+#define OTA_PROFILE_ATTR(typeUUID, permit, value) \
+    { \
+        .type = { \
+            .len = ATT_BT_UUID_SIZE, \
+            .uuid = typeUUID, \
+        }, \
+        .permissions = permit, \
+        .handle = 0, /* Will be assigned by the stack */ \
+        .pValue = (uint8_t *)(value), \
     },
-    // Characteristic 2 Value
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = otaProfileChar2UUID,
-        },
-        .permissions = GATT_PERMIT_READ | GATT_PERMIT_WRITE,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar2Val,
-    },
-    // Characteristic 2 User Description
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = charUserDescUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar2UserDesc,
-    },
-    // Characteristic 3 Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = characterUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = &otaProfileChar3Props,
-    },
-    // Characteristic 3 Value
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = otaProfileChar3UUID,
-        },
-        .permissions = GATT_PERMIT_READ | GATT_PERMIT_WRITE,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar3Val,
-    },
-    // Characteristic 3 User Description
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = charUserDescUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar3UserDesc,
-    },
-    // Characteristic 4 Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = characterUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = &otaProfileChar4Props,
-    },
-    // Characteristic 4 Value
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = otaProfileChar4UUID,
-        },
-        .permissions = GATT_PERMIT_READ | GATT_PERMIT_WRITE,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar4Val,
-    },
-    // Characteristic 4 User Description
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = charUserDescUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar4UserDesc,
-    },
-    // Characteristic 5 Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = characterUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = &otaProfileChar5Props,
-    },
-    // Characteristic 5 Value
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = otaProfileChar5UUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = NULL,
-    },
-    // Characteristic 5 User Description
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = charUserDescUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar5UserDesc,
-    },
-    // Characteristic 6 Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = characterUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = &otaProfileChar6Props,
-    },
-    // Characteristic 6 Value
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = otaProfileChar6UUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = NULL,
-    },
-    // Characteristic 6 User Description
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = charUserDescUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar6UserDesc,
-    },
-    // Characteristic 7 Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = characterUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = &otaProfileChar7Props,
-    },
-    // Characteristic 7 Value
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = otaProfileChar7UUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = NULL,
-    },
-    // Characteristic 7 User Description
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = charUserDescUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar7UserDesc,
-    },
-    // Characteristic 8 Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = characterUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = &otaProfileChar8Props,
-    },
-    // Characteristic 8 Value
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = otaProfileChar8UUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = NULL,
-    },
-    // Characteristic 8 User Description
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = charUserDescUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar8UserDesc,
-    },
-    // Characteristic 9 Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = characterUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = &otaProfileChar9Props,
-    },
-    // Characteristic 9 Value
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = otaProfileChar9UUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = NULL,
-    },
-    // Characteristic 9 User Description
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = charUserDescUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar9UserDesc,
-    },
-    // Characteristic 10 Declaration
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = characterUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = &otaProfileChar10Props,
-    },
-    // Characteristic 10 Value
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = otaProfileChar10UUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = NULL,
-    },
-    // Characteristic 10 User Description
-    {
-        .type = {
-            .len = ATT_BT_UUID_SIZE,
-            .uuid = charUserDescUUID,
-        },
-        .permissions = GATT_PERMIT_READ,
-        .handle = 0, // Will be assigned by the stack
-        .pValue = otaProfileChar10UserDesc,
-    }
+#define OTA_PROFILE_CHAR_ATTRS(n, uuid, props, permit, value, desc, read, write) \
+    OTA_PROFILE_ATTR(characterUUID, GATT_PERMIT_READ, &otaProfileChar##n##Props) \
+    OTA_PROFILE_ATTR(otaProfileChar##n##UUID, permit, value) \
+    OTA_PROFILE_ATTR(charUserDescUUID, GATT_PERMIT_READ, otaProfileChar##n##UserDesc)
+#define OTA_PROFILE_CHAR_NOTIFY_ATTRS(n, uuid, props, permit, value, desc, read, write) \
+    OTA_PROFILE_ATTR(characterUUID, GATT_PERMIT_READ, &otaProfileChar##n##Props) \
+    OTA_PROFILE_ATTR(otaProfileChar##n##UUID, permit, value) \
+    OTA_PROFILE_ATTR(clientCharCfgUUID, GATT_PERMIT_READ | GATT_PERMIT_WRITE, otaProfileChar##n##Config) \
+    OTA_PROFILE_ATTR(charUserDescUUID, GATT_PERMIT_READ, otaProfileChar##n##UserDesc)
+
+static gattAttribute_t otaProfileAttrTbl[OTA_PROFILE_ATTR_COUNT] = {
+    // Service Declaration
+    OTA_PROFILE_ATTR(primaryServiceUUID, GATT_PERMIT_READ, &otaProfileService)
+    OTA_PROFILE_CHAR_LIST(OTA_PROFILE_CHAR_ATTRS, OTA_PROFILE_CHAR_NOTIFY_ATTRS)
 };
 
 // Callback function definition
@@ -502,6 +193,34 @@ void OTAProfile_RandomNextChallenge(void)
     }
 }
 
+static void OTAProfile_HandleConnStatusCB(uint16_t connHandle, uint8_t changeType)
+{
+    // Make sure this is not loopback connection
+    if(connHandle != LOOPBACK_CONNHANDLE)
+    {
+        // Drop the open stream and the session key if connection has dropped
+        if((changeType == LINKDB_STATUS_UPDATE_REMOVED) ||
+           ((changeType == LINKDB_STATUS_UPDATE_STATEFLAGS) &&
+            (!linkDB_Up(connHandle))))
+        {
+            ota_cmd_stream_abort();
+            ota_cmd_session_end();
+            GATTServApp_InitCharCfg(connHandle, otaProfileChar1Config);
+            GATTServApp_InitCharCfg(connHandle, otaProfileChar11Config);
+            otaProfileBulkNextSeq = 0;
+            otaProfileBulkState = OTA_BULK_OK;
+            if(connHandle == otaProfileBulkConnHandle)
+            {
+                otaProfileBulkConnHandle = INVALID_CONNHANDLE;
+            }
+            if(connHandle == otaProfileCmdConnHandle)
+            {
+                otaProfileCmdConnHandle = INVALID_CONNHANDLE;
+            }
+        }
+    }
+}
+
 bStatus_t OTAProfile_AddService(void)
 {
     uint8_t status;
@@ -509,9 +228,23 @@ bStatus_t OTAProfile_AddService(void)
     // Generate the first random challenge token
     OTAProfile_RandomNextChallenge();
 
+    // No client has enabled completion notifications yet
+    GATTServApp_InitCharCfg(INVALID_CONNHANDLE, otaProfileChar1Config);
+    GATTServApp_InitCharCfg(INVALID_CONNHANDLE, otaProfileChar11Config);
+
+    // Register with Link DB to receive link status change callback
+    linkDB_Register(OTAProfile_HandleConnStatusCB);
+
     // Initialize the async event system
     ota_async_event_init();
 
+    // Initialize the link manager, it asks for the largest MTU on every connection
+    status = ota_link_init();
+    if(status != SUCCESS)
+    {
+        return status;
+    }
+
     // Register the service with the GATT server
     status = GATTServApp_RegisterService(
         otaProfileAttrTbl, 
@@ -523,6 +256,149 @@ bStatus_t OTAProfile_AddService(void)
     return status;
 }
 
+/**
+ * @brief Check if an IO buffer is held by the OTA engine
+ * A buffer is held while it is programmed or queued as the next stream chunk.
+ * Any other asynchronous operation holds both buffers.
+ */
+static uint32_t OTAProfile_IoBufferHeld(uint32_t index)
+{
+    const uint8_t *buffer = otaProfileChar2Val[index];
+    const uint8_t *programBuffer;
+
+    if(ota_cmd_stream_pending_buffer() == buffer)
+    {
+        return 1; // Queued stream chunk
+    }
+    if(!ota_is_busy_flag())
+    {
+        return 0;
+    }
+    programBuffer = ota_async_event_program_buffer();
+    return programBuffer == NULL || programBuffer == buffer;
+}
+
+/**
+ * @brief Make sure the host side IO buffer is free for writing
+ * Switches the host over to the other IO buffer if the current one has been handed to the OTA engine.
+ * Only at the start of a write, the rest of a long write must land in the buffer it started in.
+ * 
+ * @param offset Offset of the write in the IO buffer
+ */
+static bStatus_t OTAProfile_IoBufferAcquire(uint16_t offset)
+{
+    if(!OTAProfile_IoBufferHeld(otaProfileChar2Host))
+    {
+        return SUCCESS;
+    }
+    if(offset != 0)
+    {
+        // Taken by the OTA engine in the middle of a long write
+        return ATT_ERR_WRITE_NOT_PERMITTED;
+    }
+    if(OTAProfile_IoBufferHeld(otaProfileChar2Host ^ 1))
+    {
+        // Both buffers are in use, the host has to retry later
+        return ATT_ERR_WRITE_NOT_PERMITTED;
+    }
+    otaProfileChar2Host ^= 1;
+    otaProfileChar2Len[otaProfileChar2Host] = 0;
+    return SUCCESS;
+}
+
+/**
+ * @brief Fill the bulk data state readback
+ */
+static uint16_t OTAProfile_BulkStatus(uint8_t *buffer)
+{
+    uint32_t crc = CRC32_FINAL(otaProfileBulkCrc);
+
+    buffer[0] = LO_UINT16(otaProfileBulkNextSeq);
+    buffer[1] = HI_UINT16(otaProfileBulkNextSeq);
+    buffer[2] = otaProfileBulkState;
+    // Must use tmos_memcpy to copy the value to avoid RISC-V misalignment faults
+    tmos_memcpy(buffer + 3, &crc, sizeof(uint32_t));
+    return OTA_BULK_STATUS_LEN;
+}
+
+/**
+ * @brief Tell the host it can resume bulk data writes
+ * Called whenever an asynchronous operation completes, which frees at least one IO buffer.
+ * Only sent after a write was rejected as busy, the notification carries the sequence number to resume at.
+ */
+void OTAProfile_BulkResume(void)
+{
+    attHandleValueNoti_t noti;
+    uint16_t connHandle = otaProfileBulkConnHandle;
+
+    if(otaProfileBulkState != OTA_BULK_ERROR_BUSY || connHandle == INVALID_CONNHANDLE ||
+       !(GATTServApp_ReadCharCfg(connHandle, otaProfileChar11Config) & GATT_CLIENT_CFG_NOTIFY))
+    {
+        return; // Nothing to resume, or the host polls the bulk data state instead
+    }
+
+    noti.len = OTA_BULK_STATUS_LEN;
+    noti.pValue = GATT_bm_alloc(connHandle, ATT_HANDLE_VALUE_NOTI, noti.len, NULL, 0);
+    if(noti.pValue == NULL)
+    {
+        return; // Out of buffers, the bulk data readback still works
+    }
+    OTAProfile_BulkStatus(noti.pValue);
+
+    noti.handle = otaProfileAttrTbl[OTA_PROFILE_ATTR_CHAR11_VALUE].handle;
+    if(GATT_Notification(connHandle, &noti, FALSE) != SUCCESS)
+    {
+        GATT_bm_free((gattMsg_t *)&noti, ATT_HANDLE_VALUE_NOTI);
+    }
+}
+
+/**
+ * @brief Notify the host that an asynchronous OTA command has completed
+ * Saves the host from polling the status readback of the main characteristic.
+ * The result is cut to what fits in one notification.
+ * 
+ * @param opcode Opcode of the completed command
+ * @param status Result of the command
+ * @param result Pointer to the result of the command, NULL if it has none
+ * @param resultLength Length of the result
+ */
+void OTAProfile_NotifyComplete(uint8_t opcode, bStatus_t status, const uint8_t *result, uint32_t resultLength)
+{
+    attHandleValueNoti_t noti;
+    uint16_t connHandle = otaProfileCmdConnHandle;
+    uint32_t resultLen = 0;
+    uint16_t mtu;
+
+    if(connHandle == INVALID_CONNHANDLE ||
+       !(GATTServApp_ReadCharCfg(connHandle, otaProfileChar1Config) & GATT_CLIENT_CFG_NOTIFY))
+    {
+        return; // Host polls the status readback instead
+    }
+
+    mtu = ATT_GetMTU(connHandle);
+    if(result != NULL)
+    {
+        resultLen = MIN(resultLength, (uint32_t)(mtu - 3 - OTA_MAIN_NOTIFY_HEADER_LEN));
+    }
+
+    noti.len = OTA_MAIN_NOTIFY_HEADER_LEN + resultLen;
+    noti.pValue = GATT_bm_alloc(connHandle, ATT_HANDLE_VALUE_NOTI, noti.len, NULL, 0);
+    if(noti.pValue == NULL)
+    {
+        return; // Out of buffers, the status readback still works
+    }
+    noti.pValue[0] = opcode;
+    noti.pValue[1] = status;
+    noti.pValue[2] = ota_cmd_get_batch_index();
+    tmos_memcpy(noti.pValue + OTA_MAIN_NOTIFY_HEADER_LEN, result, resultLen);
+
+    noti.handle = otaProfileAttrTbl[OTA_PROFILE_ATTR_CHAR1_VALUE].handle;
+    if(GATT_Notification(connHandle, &noti, FALSE) != SUCCESS)
+    {
+        GATT_bm_free((gattMsg_t *)&noti, ATT_HANDLE_VALUE_NOTI);
+    }
+}
+
 static bStatus_t OTA_PerpareRead_Handler(
     uint8_t *pValue, 
     uint16_t *pLen, 
@@ -547,129 +423,161 @@ static bStatus_t OTA_PerpareRead_Handler(
     return SUCCESS;
 }
 
-static bStatus_t OTAProfile_ReadAttrCB(
-    uint16_t connHandle, 
-    gattAttribute_t *pAttr, 
-    uint8_t *pValue, 
-    uint16_t *pLen, 
-    uint16_t offset, 
-    uint16_t maxLen, 
-    uint8_t method
-)
+static bStatus_t OTAProfile_ReadMain(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
 {
-    if(pAttr->type.len != ATT_BT_UUID_SIZE)
-    {
-        *pLen = 0;
-        return ATT_ERR_INVALID_HANDLE; // Invalid attribute handle
-    }
-    uint16_t uuid = BUILD_UINT16(pAttr->type.uuid[0], pAttr->type.uuid[1]);
+    uint32_t _streamcursor;
+    uint32_t _programcrc;
+
+    // Read the OTA main characteristic
+    if(maxLen < OTA_MAIN_STATUS_LEN)
+        return ATT_ERR_INVALID_VALUE_SIZE; // Ensure enough space for the status readback
+    *pLen = OTA_MAIN_STATUS_LEN;
+    *((uint8_t *)pValue) = ota_is_busy_flag();
+    *((uint8_t *)pValue + 1) = ota_get_async_event_status();
+    // Must use tmos_memcpy to copy the value to avoid RISC-V misalignment faults
+    _streamcursor = ota_cmd_get_stream_cursor();
+    tmos_memcpy(pValue + 2, &_streamcursor, sizeof(uint32_t));
+    *((uint8_t *)pValue + 6) = ota_cmd_get_batch_index();
+    *((uint8_t *)pValue + 7) = otaProfileChar2Host |
+                              (OTAProfile_IoBufferHeld(0) ? OTA_IO_BUFFER_OWNER_HELD(0) : 0) |
+                              (OTAProfile_IoBufferHeld(1) ? OTA_IO_BUFFER_OWNER_HELD(1) : 0);
+    _programcrc = ota_async_event_program_crc();
+    tmos_memcpy(pValue + 8, &_programcrc, sizeof(uint32_t));
+    return SUCCESS;
+}
+
+static bStatus_t OTAProfile_ReadBuffer(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
+    // Read the OTA IO buffer
+    return OTA_PerpareRead_Handler(
+        pValue, 
+        pLen, 
+        offset, 
+        maxLen, 
+        otaProfileChar2Val[otaProfileChar2Host],
+        otaProfileChar2Len[otaProfileChar2Host]
+    );
+}
+
+static bStatus_t OTAProfile_ReadChallenge(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
+    // Read the OTA challenge token
+    return OTA_PerpareRead_Handler(
+        pValue, 
+        pLen, 
+        offset, 
+        maxLen, 
+        otaProfileChar3Val,
+        otaProfileChar3Len
+    );
+}
+
+static bStatus_t OTAProfile_ReadToken(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
+    // Read the OTA authentication token
+    return OTA_PerpareRead_Handler(
+        pValue, 
+        pLen, 
+        offset, 
+        maxLen, 
+        otaProfileChar4Val,
+        otaProfileChar4Len
+    );
+}
 
+static bStatus_t OTAProfile_ReadFlashBank(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
     uint32_t _flashbank;
-    const char *flashBankStr;
-    const char *flashModeStr;
-    const char *bootReasonStr;
-
-    switch(uuid)
-    {
-        case OTA_GATT_PROFILE_CHAR_UUID_MAIN:
-            // Read the OTA main characteristic
-            if(maxLen < sizeof(uint8_t) + sizeof(uint8_t))
-                return ATT_ERR_INVALID_VALUE_SIZE; // Ensure enough space for uint8_t
-            *pLen = sizeof(uint8_t) + sizeof(uint8_t); // 1 byte for status, 1 byte for async event status
-            *((uint8_t *)pValue) = ota_is_busy_flag();
-            *((uint8_t *)pValue + 1) = ota_get_async_event_status();
-            return SUCCESS;
-        case OTA_GATT_PROFILE_CHAR_UUID_BUFFER:
-            // Read the OTA IO buffer
-            return OTA_PerpareRead_Handler(
-                pValue, 
-                pLen, 
-                offset, 
-                maxLen, 
-                otaProfileChar2Val,
-                otaProfileChar2Len
-            );
-        case OTA_GATT_PROFILE_CHAR_UUID_CHALLENGE:
-            // Read the OTA challenge token
-            return OTA_PerpareRead_Handler(
-                pValue, 
-                pLen, 
-                offset, 
-                maxLen, 
-                otaProfileChar3Val,
-                otaProfileChar3Len
-            );
-        case OTA_GATT_PROFILE_CHAR_UUID_TOKEN:
-            // Read the OTA authentication token
-            return OTA_PerpareRead_Handler(
-                pValue, 
-                pLen, 
-                offset, 
-                maxLen, 
-                otaProfileChar4Val,
-                otaProfileChar4Len
-            );
-        case OTA_GATT_PROFILE_CHAR_UUID_FLASH_BANK:
-            // Read the OTA flash bank
-            if(maxLen < sizeof(uint32_t))
-                return ATT_ERR_INVALID_VALUE_SIZE; // Ensure enough space for uint32_t
-            *pLen = sizeof(uint32_t);
-            // Get current flash bank and fill pValue
-            // Must use tmos_memcpy to copy the value to avoid RISC-V misalignment faults
-            _flashbank = ota_get_flags_current_flash_bank();
-            tmos_memcpy(pValue, &_flashbank, sizeof(uint32_t));
-            return SUCCESS;
-        case OTA_GATT_PROFILE_CHAR_UUID_FLASH_BANK_READABLE:
-            // Read the OTA flash bank as a string
-            flashBankStr = ota_get_flags_current_flash_bank_string(); // Function to get flash bank as string    
-            return OTA_PerpareRead_Handler( 
-                pValue, 
-                pLen, 
-                offset, 
-                maxLen, 
-                (const uint8_t *)flashBankStr,
-                tmos_strlen((char *)flashBankStr)
-            );
-        case OTA_GATT_PROFILE_CHAR_UUID_FLASH_MODE:
-            // Read the OTA flash mode
-            if(maxLen < sizeof(uint8_t))
-                return ATT_ERR_INVALID_VALUE_SIZE; // Ensure enough space for uint8_t
-            *pLen = sizeof(uint8_t);
-            *((uint8_t *)pValue) = ota_get_flags_flash_mode_flag(); // Function to get current flash mode
-            return SUCCESS;
-        case OTA_GATT_PROFILE_CHAR_UUID_FLASH_MODE_READABLE:
-            // Read the OTA flash mode as a string
-            flashModeStr = ota_get_flags_flash_mode_flag_string(); // Function to get flash mode as string
-            return OTA_PerpareRead_Handler(
-                pValue, 
-                pLen, 
-                offset, 
-                maxLen, 
-                (const uint8_t *)flashModeStr,
-                tmos_strlen((char *)flashModeStr)
-            );
-        case OTA_GATT_PROFILE_CHAR_UUID_BOOT_REASON:
-            // Read the OTA boot reason
-            if(maxLen < sizeof(uint8_t))
-                return ATT_ERR_INVALID_VALUE_SIZE; // Ensure enough space for uint8_t
-            *pLen = sizeof(uint8_t);
-            *((uint8_t *)pValue) = ota_get_flags_boot_reason_code(); // Function to get current boot reason
-            return SUCCESS;
-        case OTA_GATT_PROFILE_CHAR_UUID_BOOT_REASON_READABLE:
-            // Read the OTA boot reason as a string
-            bootReasonStr = ota_get_flags_boot_reason_code_string(); // Function to get boot reason as string
-            return OTA_PerpareRead_Handler(
-                pValue, 
-                pLen, 
-                offset, 
-                maxLen, 
-                (const uint8_t *)bootReasonStr,
-                tmos_strlen((char *)bootReasonStr)
-            );
-        default:
-            *pLen = 0;
-            return ATT_ERR_ATTR_NOT_FOUND; // Attribute not found
-    }
+
+    // Read the OTA flash bank
+    if(maxLen < sizeof(uint32_t))
+        return ATT_ERR_INVALID_VALUE_SIZE; // Ensure enough space for uint32_t
+    *pLen = sizeof(uint32_t);
+    // Get current flash bank and fill pValue
+    // Must use tmos_memcpy to copy the value to avoid RISC-V misalignment faults
+    _flashbank = ota_get_flags_current_flash_bank();
+    tmos_memcpy(pValue, &_flashbank, sizeof(uint32_t));
+    return SUCCESS;
+}
+
+static bStatus_t OTAProfile_ReadFlashBankString(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
+    // Read the OTA flash bank as a string
+    const char *flashBankStr = ota_get_flags_current_flash_bank_string(); // Function to get flash bank as string
+    return OTA_PerpareRead_Handler(
+        pValue, 
+        pLen, 
+        offset, 
+        maxLen, 
+        (const uint8_t *)flashBankStr,
+        tmos_strlen((char *)flashBankStr)
+    );
+}
+
+static bStatus_t OTAProfile_ReadFlashMode(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
+    // Read the OTA flash mode
+    if(maxLen < sizeof(uint8_t))
+        return ATT_ERR_INVALID_VALUE_SIZE; // Ensure enough space for uint8_t
+    *pLen = sizeof(uint8_t);
+    *((uint8_t *)pValue) = ota_get_flags_flash_mode_flag(); // Function to get current flash mode
+    return SUCCESS;
+}
+
+static bStatus_t OTAProfile_ReadFlashModeString(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
+    // Read the OTA flash mode as a string
+    const char *flashModeStr = ota_get_flags_flash_mode_flag_string(); // Function to get flash mode as string
+    return OTA_PerpareRead_Handler(
+        pValue, 
+        pLen, 
+        offset, 
+        maxLen, 
+        (const uint8_t *)flashModeStr,
+        tmos_strlen((char *)flashModeStr)
+    );
+}
+
+static bStatus_t OTAProfile_ReadBootReason(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
+    // Read the OTA boot reason
+    if(maxLen < sizeof(uint8_t))
+        return ATT_ERR_INVALID_VALUE_SIZE; // Ensure enough space for uint8_t
+    *pLen = sizeof(uint8_t);
+    *((uint8_t *)pValue) = ota_get_flags_boot_reason_code(); // Function to get current boot reason
+    return SUCCESS;
+}
+
+static bStatus_t OTAProfile_ReadBootReasonString(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
+    // Read the OTA boot reason as a string
+    const char *bootReasonStr = ota_get_flags_boot_reason_code_string(); // Function to get boot reason as string
+    return OTA_PerpareRead_Handler(
+        pValue, 
+        pLen, 
+        offset, 
+        maxLen, 
+        (const uint8_t *)bootReasonStr,
+        tmos_strlen((char *)bootReasonStr)
+    );
+}
+
+static bStatus_t OTAProfile_ReadBulk(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
+    // Read the bulk data state
+    if(maxLen < OTA_BULK_STATUS_LEN)
+        return ATT_ERR_INVALID_VALUE_SIZE; // Ensure enough space for the bulk data state
+    *pLen = OTAProfile_BulkStatus(pValue);
+    return SUCCESS;
+}
+
+static bStatus_t OTAProfile_ReadLink(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen)
+{
+    // Read the negotiated MTU, the payload sizes that fit in it, the PHY and the connection parameters
+    if(maxLen < OTA_LINK_INFO_LEN)
+        return ATT_ERR_INVALID_VALUE_SIZE; // Ensure enough space for the link info
+    *pLen = ota_link_get_info(connHandle, pValue);
+    return SUCCESS;
 }
 
 static bStatus_t OTA_Write_Handler(
@@ -698,68 +606,303 @@ static bStatus_t OTA_Write_Handler(
     return SUCCESS; // Return success
 }
 
-static bStatus_t OTAProfile_WriteAttrCB(
+/**
+ * @brief Reject a bulk data write
+ * Write without response has no way to report an error, the host finds it in the status readback.
+ */
+static bStatus_t OTAProfile_BulkReject(uint8_t state)
+{
+    otaProfileBulkState = state;
+    return ATT_ERR_WRITE_NOT_PERMITTED;
+}
+
+/**
+ * @brief Hand the bulk data gathered in the host side IO buffer to the open stream
+ */
+static bStatus_t OTAProfile_BulkFlush(void)
+{
+    bStatus_t status = ota_cmd_stream_write(
+        otaProfileChar2Val[otaProfileChar2Host], 
+        otaProfileChar2Len[otaProfileChar2Host]
+    );
+    if(status != SUCCESS)
+    {
+        return OTAProfile_BulkReject(status == ATT_ERR_WRITE_NOT_PERMITTED ? OTA_BULK_ERROR_BUSY : OTA_BULK_ERROR_LENGTH);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Handle a write to the bulk data characteristic
+ * Several writes without response fit in one connection event, unlike acknowledged IO buffer writes.
+ */
+static bStatus_t OTAProfile_BulkWrite(const uint8_t *pValue, uint16_t len)
+{
+    uint16_t seq;
+    uint32_t payloadLen;
+    uint32_t streaming = ota_cmd_is_streaming();
+    uint32_t prevLen, prevCrc;
+    bStatus_t status;
+
+    if(len <= OTA_BULK_HEADER_LEN)
+    {
+        return OTAProfile_BulkReject(OTA_BULK_ERROR_LENGTH); // No payload
+    }
+    seq = BUILD_UINT16(pValue[0], pValue[1]);
+    payloadLen = len - OTA_BULK_HEADER_LEN;
+
+    if(seq == 0)
+    {
+        // Start over, the host has seen the state and resends from the last good point
+        otaProfileBulkState = OTA_BULK_OK;
+        otaProfileBulkNextSeq = 0;
+        otaProfileBulkCrc = CRC32_INIT;
+    }
+    if(otaProfileBulkState == OTA_BULK_ERROR_BUSY && seq == otaProfileBulkNextSeq)
+    {
+        // Resume point, a write rejected as busy did not change anything
+        otaProfileBulkState = OTA_BULK_OK;
+    }
+    if(otaProfileBulkState != OTA_BULK_OK)
+    {
+        return ATT_ERR_WRITE_NOT_PERMITTED; // Dropped until the host starts over or resumes
+    }
+    if(seq != otaProfileBulkNextSeq)
+    {
+        return OTAProfile_BulkReject(OTA_BULK_ERROR_SEQUENCE);
+    }
+    if(streaming && (payloadLen & 0x03) != 0)
+    {
+        return OTAProfile_BulkReject(OTA_BULK_ERROR_LENGTH); // Stream chunks are programmed in whole words
+    }
+
+    // Payload goes to the IO buffer not held by the OTA engine
+    if(OTAProfile_IoBufferAcquire(0) != SUCCESS)
+    {
+        return OTAProfile_BulkReject(OTA_BULK_ERROR_BUSY);
+    }
+    if(seq == 0)
+    {
+        otaProfileChar2Len[otaProfileChar2Host] = 0;
+    }
+    if(streaming && otaProfileChar2Len[otaProfileChar2Host] + payloadLen > OTA_IO_BUFFER_SIZE)
+    {
+        // Buffer is full, program it and continue in the other one
+        status = OTAProfile_BulkFlush();
+        if(status != SUCCESS)
+        {
+            return status;
+        }
+        if(OTAProfile_IoBufferAcquire(0) != SUCCESS)
+        {
+            return OTAProfile_BulkReject(OTA_BULK_ERROR_BUSY);
+        }
+    }
+    prevLen = otaProfileChar2Len[otaProfileChar2Host];
+    prevCrc = otaProfileBulkCrc;
+    status = OTA_Write_Handler(
+        otaProfileChar2Val[otaProfileChar2Host], 
+        &otaProfileChar2Len[otaProfileChar2Host], 
+        OTA_IO_BUFFER_SIZE, 
+        (uint8_t *)pValue + OTA_BULK_HEADER_LEN, 
+        payloadLen, 
+        otaProfileChar2Len[otaProfileChar2Host]
+    );
+    if(status != SUCCESS)
+    {
+        return OTAProfile_BulkReject(OTA_BULK_ERROR_LENGTH);
+    }
+
+    otaProfileBulkCrc = crc32_update(otaProfileBulkCrc, pValue + OTA_BULK_HEADER_LEN, payloadLen);
+    otaProfileBulkNextSeq = seq == 0xFFFF ? 1 : seq + 1;
+
+    // Program the buffer as soon as the next payload would not fit, or the stream is complete
+    if(streaming &&
+       (otaProfileChar2Len[otaProfileChar2Host] + payloadLen > OTA_IO_BUFFER_SIZE ||
+        otaProfileChar2Len[otaProfileChar2Host] == ota_cmd_get_stream_remaining()))
+    {
+        status = OTAProfile_BulkFlush();
+        if(status != SUCCESS && otaProfileBulkState == OTA_BULK_ERROR_BUSY)
+        {
+            // Take the payload back, the host resends it and the flush is retried with it
+            otaProfileChar2Len[otaProfileChar2Host] = prevLen;
+            otaProfileBulkCrc = prevCrc;
+            otaProfileBulkNextSeq = seq;
+        }
+        return status;
+    }
+    return SUCCESS;
+}
+
+static bStatus_t OTAProfile_WriteMain(uint16_t connHandle, gattAttribute_t *pAttr, uint8_t *pValue, uint16_t len, uint16_t offset)
+{
+    bStatus_t status;
+
+    if(ota_is_busy_flag())
+    {
+        // Still handling an OTA asynchronous event, cannot perform new command
+        return ATT_ERR_WRITE_NOT_PERMITTED; 
+    }
+    // Handle OTA command
+    otaProfileCmdConnHandle = connHandle;
+    status = ota_cmd_handler(
+        pValue, 
+        len, 
+        otaProfileChar2Val[otaProfileChar2Host],
+        &otaProfileChar2Len[otaProfileChar2Host],
+        otaProfileChar3Val,
+        otaProfileChar3Len,
+        otaProfileChar4Val,
+        otaProfileChar4Len
+    );
+    OTAProfile_RandomNextChallenge();
+    return status;
+}
+
+static bStatus_t OTAProfile_WriteBuffer(uint16_t connHandle, gattAttribute_t *pAttr, uint8_t *pValue, uint16_t len, uint16_t offset)
+{
+    // Writes go to the IO buffer not held by the OTA engine
+    bStatus_t status = OTAProfile_IoBufferAcquire(offset);
+    if(status != SUCCESS)
+    {
+        return status;
+    }
+    if(ota_cmd_is_streaming() && offset != 0)
+    {
+        return ATT_ERR_ATTR_NOT_LONG; // Stream chunks must fit in a single write
+    }
+    // Write to the OTA IO buffer, stream chunks are copied into the aligned IO buffer before handing them to the flash driver
+    status = OTA_Write_Handler(
+        otaProfileChar2Val[otaProfileChar2Host], 
+        &otaProfileChar2Len[otaProfileChar2Host], 
+        OTA_IO_BUFFER_SIZE, 
+        pValue, 
+        len, 
+        offset
+    );
+    if(status == SUCCESS && ota_cmd_is_streaming())
+    {
+        // Stream data, every write is one chunk programmed at the stream cursor
+        // Programmed right away, or queued behind the chunk in the other buffer
+        status = ota_cmd_stream_write(
+            otaProfileChar2Val[otaProfileChar2Host], 
+            otaProfileChar2Len[otaProfileChar2Host]
+        );
+    }
+    OTAProfile_RandomNextChallenge();
+    return status;
+}
+
+static bStatus_t OTAProfile_WriteBulk(uint16_t connHandle, gattAttribute_t *pAttr, uint8_t *pValue, uint16_t len, uint16_t offset)
+{
+    // Bulk data, same as an IO buffer write
+    if(offset != 0)
+    {
+        return ATT_ERR_ATTR_NOT_LONG; // Every write stands on its own
+    }
+    // Several writes per connection event, the challenge is left alone so the host can keep the one it read
+    // Payloads outside of a stream are covered by the token of the command that uses the IO buffer
+    otaProfileBulkConnHandle = connHandle;
+    return OTAProfile_BulkWrite(pValue, len);
+}
+
+static bStatus_t OTAProfile_WriteToken(uint16_t connHandle, gattAttribute_t *pAttr, uint8_t *pValue, uint16_t len, uint16_t offset)
+{
+    // Write the signature token
+    // This should not affect the challenge token
+    return OTA_Write_Handler(
+        otaProfileChar4Val, 
+        &otaProfileChar4Len, 
+        sizeof(otaProfileChar4Val), 
+        pValue, 
+        len, 
+        offset
+    );
+}
+
+static bStatus_t OTAProfile_WriteCharCfg(uint16_t connHandle, gattAttribute_t *pAttr, uint8_t *pValue, uint16_t len, uint16_t offset)
+{
+    // Enable or disable the completion notifications
+    // This should not affect the challenge token
+    return GATTServApp_ProcessCCCWriteReq(connHandle, pAttr, pValue, len, offset, GATT_CLIENT_CFG_NOTIFY);
+}
+
+// Attribute handlers, indexed like the attribute table
+typedef bStatus_t (*otaProfileReadHandler_t)(uint16_t connHandle, uint8_t *pValue, uint16_t *pLen, uint16_t offset, uint16_t maxLen);
+typedef bStatus_t (*otaProfileWriteHandler_t)(uint16_t connHandle, gattAttribute_t *pAttr, uint8_t *pValue, uint16_t len, uint16_t offset);
+
+typedef struct
+{
+    otaProfileReadHandler_t read;
+    otaProfileWriteHandler_t write;
+} otaProfileAttrHandler_t;
+
+#define OTA_PROFILE_CHAR_HANDLERS(n, uuid, props, permit, value, desc, read, write) \
+    [OTA_PROFILE_ATTR_CHAR##n##_VALUE] = { read, write },
+#define OTA_PROFILE_CHAR_NOTIFY_HANDLERS(n, uuid, props, permit, value, desc, read, write) \
+    [OTA_PROFILE_ATTR_CHAR##n##_VALUE] = { read, write }, \
+    [OTA_PROFILE_ATTR_CHAR##n##_CONFIG] = { NULL, OTAProfile_WriteCharCfg },
+
+static const otaProfileAttrHandler_t otaProfileAttrHandlers[OTA_PROFILE_ATTR_COUNT] = {
+    OTA_PROFILE_CHAR_LIST(OTA_PROFILE_CHAR_HANDLERS, OTA_PROFILE_CHAR_NOTIFY_HANDLERS)
+};
+
+/**
+ * @brief Get the handlers of an attribute from its position in the attribute table
+ * Constant time, the UUID of the attribute is never decoded.
+ */
+static const otaProfileAttrHandler_t *OTAProfile_AttrHandler(const gattAttribute_t *pAttr)
+{
+    if(pAttr < otaProfileAttrTbl || pAttr >= otaProfileAttrTbl + OTA_PROFILE_ATTR_COUNT)
+    {
+        return NULL; // Not an attribute of this service
+    }
+    return &otaProfileAttrHandlers[pAttr - otaProfileAttrTbl];
+}
+
+static bStatus_t OTAProfile_ReadAttrCB(
     uint16_t connHandle, 
     gattAttribute_t *pAttr, 
     uint8_t *pValue, 
-    uint16_t len, 
+    uint16_t *pLen, 
     uint16_t offset, 
+    uint16_t maxLen, 
     uint8_t method
 )
 {
-    if(pAttr->type.len != ATT_BT_UUID_SIZE)
+    const otaProfileAttrHandler_t *handler = OTAProfile_AttrHandler(pAttr);
+
+    if(handler == NULL)
     {
+        *pLen = 0;
         return ATT_ERR_INVALID_HANDLE; // Invalid attribute handle
     }
-    uint16_t uuid = BUILD_UINT16(pAttr->type.uuid[0], pAttr->type.uuid[1]);
-    bStatus_t status;
-
-    if(ota_is_busy_flag())
+    if(handler->read == NULL)
     {
-        // Still handling an OTA asynchronous event, cannot perform new write
-        return ATT_ERR_WRITE_NOT_PERMITTED; 
+        *pLen = 0;
+        return ATT_ERR_ATTR_NOT_FOUND; // Attribute not found
     }
+    return handler->read(connHandle, pValue, pLen, offset, maxLen);
+}
+
+static bStatus_t OTAProfile_WriteAttrCB(
+    uint16_t connHandle, 
+    gattAttribute_t *pAttr, 
+    uint8_t *pValue, 
+    uint16_t len, 
+    uint16_t offset, 
+    uint8_t method
+)
+{
+    const otaProfileAttrHandler_t *handler = OTAProfile_AttrHandler(pAttr);
 
-    switch(uuid)
-    {
-        case OTA_GATT_PROFILE_CHAR_UUID_MAIN:
-            // Handle OTA command
-            status = ota_cmd_handler(
-                pValue, 
-                len, 
-                otaProfileChar2Val,
-                &otaProfileChar2Len,
-                otaProfileChar3Val,
-                otaProfileChar3Len,
-                otaProfileChar4Val,
-                otaProfileChar4Len
-            );
-            break;
-        case OTA_GATT_PROFILE_CHAR_UUID_BUFFER:
-            // Write to the OTA IO buffer
-            status = OTA_Write_Handler(
-                otaProfileChar2Val, 
-                &otaProfileChar2Len, 
-                OTA_IO_BUFFER_SIZE, 
-                pValue, 
-                len, 
-                offset
-            );
-            break;
-        case OTA_GATT_PROFILE_CHAR_UUID_TOKEN:
-            // Write the signature token
-            // Directly return, this should not affect the challenge token
-            return OTA_Write_Handler(
-                otaProfileChar4Val, 
-                &otaProfileChar4Len, 
-                sizeof(otaProfileChar4Val), 
-                pValue, 
-                len, 
-                offset
-            );
-        default:
-            return ATT_ERR_ATTR_NOT_FOUND; // Attribute not found
+    if(handler == NULL)
+    {
+        return ATT_ERR_INVALID_HANDLE; // Invalid attribute handle
     }
-    OTAProfile_RandomNextChallenge();
-    return status;
+    if(handler->write == NULL)
+    {
+        return ATT_ERR_ATTR_NOT_FOUND; // Attribute not found
+    }
+    return handler->write(connHandle, pAttr, pValue, len, offset);
 }
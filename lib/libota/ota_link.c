@@ -0,0 +1,258 @@
+// ota_link.c
+// This file contains the implementation of the OTA link manager.
+// Asks for the largest ATT MTU and tracks the PHY, so the host can size its writes to exactly one link-layer packet.
+// Switches the connection to a fast parameter set while an OTA session is active and back to a power saving one after.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ota_link.h"
+#include "ota_gatt_profile.h"
+
+static uint8_t link_task_id = INVALID_TASK_ID;
+
+// The peripheral serves one link at a time
+static uint16_t ota_link_conn_handle = INVALID_CONNHANDLE;
+static uint8_t ota_link_tx_phy = GAP_PHY_VAL_LE_1M;
+static uint8_t ota_link_rx_phy = GAP_PHY_VAL_LE_1M;
+
+// Connection parameters as reported by the last parameter update
+static uint16_t ota_link_interval = 0;
+static uint16_t ota_link_latency = 0;
+static uint16_t ota_link_timeout = 0;
+static uint8_t ota_link_params_state = OTA_LINK_PARAMS_IDLE;
+
+/**
+ * @brief Prepare the link manager
+ * The MTU exchange is a GATT client procedure, so the GATT client is needed next to the server.
+ * 
+ * @return bStatus_t Result of the task registration
+ */
+bStatus_t ota_link_init(void)
+{
+    GATT_InitClient();
+
+    link_task_id = TMOS_ProcessEventRegister(ota_link_process_event);
+    if (link_task_id == INVALID_TASK_ID)
+    {
+        return bleMemAllocError; // Failed to register the task
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Process the link manager events
+ * 
+ * @param task_id Task ID of the link manager
+ * @param events Events to process
+ * 
+ * @return uint16_t Unprocessed events
+ */
+uint16_t ota_link_process_event(uint8_t task_id, uint16_t events)
+{
+    if (events & SYS_EVENT_MSG)
+    {
+        uint8_t *pMsg;
+
+        // Parameter update responses of the central, the outcome is reported by the update callback
+        if ((pMsg = tmos_msg_receive(link_task_id)) != NULL)
+        {
+            tmos_msg_deallocate(pMsg);
+        }
+        return (events ^ SYS_EVENT_MSG);
+    }
+
+    if (events & OTA_LINK_EVENT_SESSION_TIMEOUT)
+    {
+        // The host went quiet without confirming, do not keep the link on the fast parameters
+        ota_link_session_end();
+        return (events ^ OTA_LINK_EVENT_SESSION_TIMEOUT);
+    }
+
+    // Discard unprocessed events
+    return 0;
+}
+
+/**
+ * @brief Ask for the largest MTU on a new connection
+ * The PHY update is started by the application, see SBP_PHY_UPDATE_EVT.
+ * 
+ * @param connHandle Handle of the new connection
+ * @param taskId Task receiving the exchange response
+ */
+void ota_link_connected(uint16_t connHandle, uint8_t taskId)
+{
+    attExchangeMTUReq_t req;
+
+    ota_link_conn_handle = connHandle;
+    ota_link_tx_phy = GAP_PHY_VAL_LE_1M;
+    ota_link_rx_phy = GAP_PHY_VAL_LE_1M;
+    ota_link_interval = 0;
+    ota_link_latency = 0;
+    ota_link_timeout = 0;
+    ota_link_params_state = OTA_LINK_PARAMS_IDLE;
+
+    if (OTA_LINK_MAX_MTU > ATT_MTU_SIZE)
+    {
+        // Do not wait for the host, most centrals only answer an exchange
+        req.clientRxMTU = OTA_LINK_MAX_MTU;
+        GATT_ExchangeMTU(connHandle, &req, taskId);
+    }
+}
+
+/**
+ * @brief Record the PHY of a connection
+ * 
+ * @param connHandle Handle of the connection
+ * @param txPhy TX PHY (GAP_PHY_VAL_TYPE)
+ * @param rxPhy RX PHY (GAP_PHY_VAL_TYPE)
+ */
+void ota_link_phy_updated(uint16_t connHandle, uint8_t txPhy, uint8_t rxPhy)
+{
+    if (connHandle != ota_link_conn_handle)
+        return;
+    ota_link_tx_phy = txPhy;
+    ota_link_rx_phy = rxPhy;
+}
+
+/**
+ * @brief Record the connection parameters of a connection
+ * The central may pick any interval in the requested range, or ignore the request altogether.
+ * 
+ * @param connHandle Handle of the connection
+ * @param connInterval Connection interval in 1.25ms units
+ * @param connSlaveLatency Slave latency
+ * @param connTimeout Supervision timeout in 10ms units
+ */
+void ota_link_param_updated(uint16_t connHandle, uint16_t connInterval, uint16_t connSlaveLatency, uint16_t connTimeout)
+{
+    if (connHandle != ota_link_conn_handle)
+        return;
+    ota_link_interval = connInterval;
+    ota_link_latency = connSlaveLatency;
+    ota_link_timeout = connTimeout;
+
+    if (ota_link_params_state == OTA_LINK_PARAMS_IDLE)
+        return;
+    if (connInterval >= OTA_LINK_FAST_MIN_INTERVAL && connInterval <= OTA_LINK_FAST_MAX_INTERVAL &&
+       connSlaveLatency == OTA_LINK_FAST_LATENCY)
+        ota_link_params_state = OTA_LINK_PARAMS_FAST;
+    else
+        ota_link_params_state = OTA_LINK_PARAMS_FAST_REJECTED;
+}
+
+/**
+ * @brief Request the connection parameters of the current state
+ * Fast parameters during an OTA session, idle parameters otherwise.
+ * 
+ * @return bStatus_t Result of the request
+ */
+static bStatus_t ota_link_update_params(void)
+{
+    if (ota_link_conn_handle == INVALID_CONNHANDLE)
+        return bleNotConnected;
+
+    if (ota_link_params_state == OTA_LINK_PARAMS_IDLE)
+    {
+        return GAPRole_PeripheralConnParamUpdateReq(
+            ota_link_conn_handle,
+            OTA_LINK_IDLE_MIN_INTERVAL,
+            OTA_LINK_IDLE_MAX_INTERVAL,
+            OTA_LINK_IDLE_LATENCY,
+            OTA_LINK_IDLE_TIMEOUT,
+            link_task_id
+        );
+    }
+    return GAPRole_PeripheralConnParamUpdateReq(
+        ota_link_conn_handle,
+        OTA_LINK_FAST_MIN_INTERVAL,
+        OTA_LINK_FAST_MAX_INTERVAL,
+        OTA_LINK_FAST_LATENCY,
+        OTA_LINK_FAST_TIMEOUT,
+        link_task_id
+    );
+}
+
+/**
+ * @brief Switch to the fast parameters on the first OTA command and restart the session timeout
+ * The parameters are only requested once per session, a rejected request is not retried.
+ */
+void ota_link_session_activity(void)
+{
+    if (ota_link_conn_handle == INVALID_CONNHANDLE)
+        return;
+
+    if (ota_link_params_state == OTA_LINK_PARAMS_IDLE)
+    {
+        ota_link_params_state = OTA_LINK_PARAMS_FAST_PENDING;
+        ota_link_update_params();
+    }
+    tmos_start_task(link_task_id, OTA_LINK_EVENT_SESSION_TIMEOUT, MS1_TO_SYSTEM_TIME(OTA_LINK_SESSION_TIMEOUT_MS));
+}
+
+/**
+ * @brief Switch back to the idle parameters, after CONFIRM or when the session timed out
+ */
+void ota_link_session_end(void)
+{
+    tmos_stop_task(link_task_id, OTA_LINK_EVENT_SESSION_TIMEOUT);
+    if (ota_link_params_state == OTA_LINK_PARAMS_IDLE)
+        return;
+
+    ota_link_params_state = OTA_LINK_PARAMS_IDLE;
+    ota_link_update_params();
+}
+
+/**
+ * @brief Forget a terminated connection
+ * 
+ * @param connHandle Handle of the connection
+ */
+void ota_link_terminated(uint16_t connHandle)
+{
+    if (connHandle != ota_link_conn_handle)
+        return;
+    ota_link_conn_handle = INVALID_CONNHANDLE;
+    ota_link_params_state = OTA_LINK_PARAMS_IDLE;
+    tmos_stop_task(link_task_id, OTA_LINK_EVENT_SESSION_TIMEOUT);
+}
+
+/**
+ * @brief Fill the OTA link characteristic value of a connection
+ * The MTU is taken from the stack, it is what the exchange ended up with.
+ * 
+ * @param connHandle Handle of the connection
+ * @param buffer Pointer to store the value, OTA_LINK_INFO_LEN bytes
+ * 
+ * @return uint16_t Length of the value
+ */
+uint16_t ota_link_get_info(uint16_t connHandle, uint8_t *buffer)
+{
+    uint16_t mtu = ATT_GetMTU(connHandle);
+    uint16_t write_len = MIN(mtu - OTA_LINK_ATT_WRITE_HEADER_LEN, OTA_IO_BUFFER_SIZE);
+    uint16_t bulk_len = MIN(mtu - OTA_LINK_ATT_WRITE_HEADER_LEN - OTA_BULK_HEADER_LEN, OTA_IO_BUFFER_SIZE) & ~0x03;
+    uint8_t known = connHandle == ota_link_conn_handle;
+
+    tmos_memset(buffer, 0, OTA_LINK_INFO_LEN);
+    buffer[0] = LO_UINT16(mtu);
+    buffer[1] = HI_UINT16(mtu);
+    buffer[2] = LO_UINT16(write_len);
+    buffer[3] = HI_UINT16(write_len);
+    buffer[4] = LO_UINT16(bulk_len);
+    buffer[5] = HI_UINT16(bulk_len);
+    buffer[6] = GAP_PHY_VAL_LE_1M;
+    buffer[7] = GAP_PHY_VAL_LE_1M;
+    if (known)
+    {
+        buffer[6] = ota_link_tx_phy;
+        buffer[7] = ota_link_rx_phy;
+        buffer[8] = LO_UINT16(ota_link_interval);
+        buffer[9] = HI_UINT16(ota_link_interval);
+        buffer[10] = LO_UINT16(ota_link_latency);
+        buffer[11] = HI_UINT16(ota_link_latency);
+        buffer[12] = LO_UINT16(ota_link_timeout);
+        buffer[13] = HI_UINT16(ota_link_timeout);
+        buffer[14] = ota_link_params_state;
+    }
+    return OTA_LINK_INFO_LEN;
+}
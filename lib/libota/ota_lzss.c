@@ -0,0 +1,168 @@
+// ota_lzss.c
+// This file contains the implementation of the streaming LZSS decompressor used by compressed OTA programming.
+// The decompressor needs no window buffer of its own, matches are read back from the output slice or from programmed flash.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ota_lzss.h"
+
+/**
+ * @brief Read the next item of the compressed stream
+ *
+ * @param ctx Pointer to the decompressor state
+ * @param literal Pointer to store the literal byte, set if the item is a literal
+ * @param offset Pointer to store the match offset, 0 if the item is a literal
+ * @param length Pointer to store the match length
+ *
+ * @return bStatus_t SUCCESS, or ATT_ERR_INVALID_VALUE if the input ends in the middle of an item
+ */
+static bStatus_t ota_lzss_next_item(ota_lzss_ctx_t *ctx, uint8_t *literal, uint32_t *offset, uint32_t *length) {
+    uint32_t is_literal;
+
+    if (ctx->flag_count == 0) {
+        if (ctx->in_offset >= ctx->in_length) {
+            return ATT_ERR_INVALID_VALUE; // Input ended before the output was complete
+        }
+        ctx->flags = ctx->in[ctx->in_offset++];
+        ctx->flag_count = 8;
+    }
+    is_literal = ctx->flags & 0x01;
+    ctx->flags >>= 1;
+    ctx->flag_count--;
+
+    if (is_literal) {
+        if (ctx->in_offset >= ctx->in_length) {
+            return ATT_ERR_INVALID_VALUE;
+        }
+        *literal = ctx->in[ctx->in_offset++];
+        *offset = 0;
+        *length = 1;
+        return SUCCESS;
+    }
+
+    if (ctx->in_length - ctx->in_offset < 2) {
+        return ATT_ERR_INVALID_VALUE;
+    }
+    *offset = (ctx->in[ctx->in_offset] | ((uint32_t)(ctx->in[ctx->in_offset + 1] & 0xF0) << 4)) + 1;
+    *length = (ctx->in[ctx->in_offset + 1] & 0x0F) + OTA_LZSS_MIN_MATCH;
+    ctx->in_offset += 2;
+    return SUCCESS;
+}
+
+/**
+ * @brief Walk the compressed stream without producing output
+ * Run before anything is programmed, so a malformed stream never leaves a partially written range behind.
+ *
+ * @param in Pointer to the compressed input
+ * @param in_length Length of the compressed input
+ * @param out_length Expected length of the decompressed output
+ * @param history_length Bytes already programmed in front of the output, the window may reach into them
+ *
+ * @return bStatus_t Result of the check
+ */
+bStatus_t ota_lzss_check(const uint8_t *in, uint32_t in_length, uint32_t out_length, uint32_t history_length) {
+    ota_lzss_ctx_t ctx;
+    uint32_t produced = 0;
+    uint32_t offset, length;
+    uint8_t literal;
+    bStatus_t status;
+
+    ota_lzss_init(&ctx, in, in_length, 0);
+    while (produced < out_length) {
+        status = ota_lzss_next_item(&ctx, &literal, &offset, &length);
+        if (status != SUCCESS) {
+            return status;
+        }
+        if (offset > history_length + produced) {
+            return ATT_ERR_INVALID_VALUE; // Match reaches in front of the programmed history
+        }
+        if (length > out_length - produced) {
+            return ATT_ERR_INVALID_VALUE; // Match runs past the expected output
+        }
+        produced += length;
+    }
+
+    if (ctx.in_offset != ctx.in_length) {
+        return ATT_ERR_INVALID_VALUE_SIZE; // Trailing data after the expected output
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Start decoding a compressed stream
+ *
+ * @param ctx Pointer to the decompressor state
+ * @param in Pointer to the compressed input, must stay untouched while decoding
+ * @param in_length Length of the compressed input
+ * @param out_address Flash address where the output will be programmed
+ */
+void ota_lzss_init(ota_lzss_ctx_t *ctx, const uint8_t *in, uint32_t in_length, uint32_t out_address) {
+    ctx->in = in;
+    ctx->in_length = in_length;
+    ctx->in_offset = 0;
+    ctx->out_address = out_address;
+    ctx->match_address = 0;
+    ctx->match_remaining = 0;
+    ctx->flags = 0;
+    ctx->flag_count = 0;
+}
+
+/**
+ * @brief Decode the next slice of output
+ * Output in front of the slice must already be programmed, matches reaching into it are read from flash.
+ * The stream must have been checked by ota_lzss_check before.
+ *
+ * @param ctx Pointer to the decompressor state
+ * @param out Pointer to the output slice, programmed at ctx->out_address afterwards
+ * @param out_length Number of bytes to decode
+ *
+ * @return bStatus_t Result of the decoding
+ */
+bStatus_t ota_lzss_decode(ota_lzss_ctx_t *ctx, uint8_t *out, uint32_t out_length) {
+    uint32_t slice_address = ctx->out_address;
+    uint32_t produced = 0;
+    uint32_t offset, length;
+    uint8_t literal;
+    bStatus_t status;
+
+    while (produced < out_length) {
+        if (ctx->match_remaining == 0) {
+            status = ota_lzss_next_item(ctx, &literal, &offset, &length);
+            if (status != SUCCESS) {
+                return status;
+            }
+            if (offset == 0) {
+                out[produced++] = literal;
+                ctx->out_address++;
+                continue;
+            }
+            ctx->match_address = ctx->out_address - offset;
+            ctx->match_remaining = length;
+        }
+
+        // Byte by byte, a match may overlap its own output
+        // Code flash is memory mapped, programmed history is read in place
+        if (ctx->match_address >= slice_address) {
+            out[produced++] = out[ctx->match_address - slice_address];
+        } else {
+            out[produced++] = *(const uint8_t *)(uintptr_t)ctx->match_address;
+        }
+        ctx->match_address++;
+        ctx->match_remaining--;
+        ctx->out_address++;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Check if the whole compressed input has been consumed
+ *
+ * @param ctx Pointer to the decompressor state
+ *
+ * @return uint32_t 1 if the input is consumed and no match is pending, 0 otherwise
+ */
+uint32_t ota_lzss_is_finished(const ota_lzss_ctx_t *ctx) {
+    return ctx->match_remaining == 0 && ctx->in_offset == ctx->in_length;
+}
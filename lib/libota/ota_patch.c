@@ -0,0 +1,229 @@
+// ota_patch.c
+// This file contains the implementation of the patch engine used by delta OTA programming.
+// The new image is rebuilt from instructions that reference the running bank, which is read in place from mapped flash.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ota_patch.h"
+#include "ota_flash_layout.h"
+
+/**
+ * @brief Read a little-endian field from the patch instructions
+ *
+ * @param ctx Pointer to the patch engine state
+ * @param size Size of the field in bytes
+ * @param value Pointer to store the field value
+ *
+ * @return bStatus_t SUCCESS, or ATT_ERR_INVALID_VALUE if the instructions end in the middle of the field
+ */
+static bStatus_t ota_patch_read_field(ota_patch_ctx_t *ctx, uint32_t size, uint32_t *value) {
+    if (ctx->in_length - ctx->in_offset < size) {
+        return ATT_ERR_INVALID_VALUE;
+    }
+    *value = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        *value |= (uint32_t)ctx->in[ctx->in_offset++] << (i * 8);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Read the next instruction header
+ *
+ * @param ctx Pointer to the patch engine state
+ *
+ * @return bStatus_t Result of the parsing
+ */
+static bStatus_t ota_patch_next_instruction(ota_patch_ctx_t *ctx) {
+    uint32_t source_offset = 0;
+    uint32_t length;
+    bStatus_t status;
+
+    if (ctx->in_offset >= ctx->in_length) {
+        return ATT_ERR_INVALID_VALUE; // Instructions ended before the output was complete
+    }
+    ctx->opcode = ctx->in[ctx->in_offset++];
+
+    switch (ctx->opcode) {
+        case OTA_PATCH_OP_COPY:
+        case OTA_PATCH_OP_DIFF:
+            status = ota_patch_read_field(ctx, sizeof(uint32_t), &source_offset);
+            if (status != SUCCESS) {
+                return status;
+            }
+            break;
+        case OTA_PATCH_OP_INSERT:
+            break;
+        default:
+            return ATT_ERR_INVALID_VALUE; // Unknown instruction
+    }
+    status = ota_patch_read_field(ctx, sizeof(uint16_t), &length);
+    if (status != SUCCESS) {
+        return status;
+    }
+    if (length == 0) {
+        return ATT_ERR_INVALID_VALUE;
+    }
+    if (ctx->opcode != OTA_PATCH_OP_INSERT &&
+        (source_offset > OTA_FLASH_BANK_SIZE || length > OTA_FLASH_BANK_SIZE - source_offset)) {
+        return bleInvalidRange; // Source range outside of the running bank
+    }
+
+    ctx->source_address = ctx->source_entry + source_offset;
+    ctx->remaining = length;
+    ctx->run_remaining = 0;
+    return SUCCESS;
+}
+
+/**
+ * @brief Read the next delta run control byte of a DIFF instruction
+ *
+ * @param ctx Pointer to the patch engine state
+ *
+ * @return bStatus_t Result of the parsing
+ */
+static bStatus_t ota_patch_next_run(ota_patch_ctx_t *ctx) {
+    uint8_t control;
+
+    if (ctx->in_offset >= ctx->in_length) {
+        return ATT_ERR_INVALID_VALUE;
+    }
+    control = ctx->in[ctx->in_offset++];
+    if (control < OTA_PATCH_RUN_UNCHANGED) {
+        ctx->run_delta = 1;
+        ctx->run_remaining = control + 1;
+    } else {
+        ctx->run_delta = 0;
+        ctx->run_remaining = control - OTA_PATCH_RUN_UNCHANGED + 1;
+    }
+    if (ctx->run_remaining > ctx->remaining) {
+        return ATT_ERR_INVALID_VALUE; // Run exceeds the DIFF length
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Walk the patch instructions without producing output
+ * Run before anything is programmed, so a malformed patch never leaves a partially written range behind.
+ *
+ * @param in Pointer to the patch instructions
+ * @param in_length Length of the patch instructions
+ * @param out_length Expected length of the output
+ * @param source_entry Entry address of the running bank
+ *
+ * @return bStatus_t Result of the check
+ */
+bStatus_t ota_patch_check(const uint8_t *in, uint32_t in_length, uint32_t out_length, uint32_t source_entry) {
+    ota_patch_ctx_t ctx;
+    bStatus_t status;
+
+    ota_patch_init(&ctx, in, in_length, source_entry);
+    status = ota_patch_apply(&ctx, NULL, out_length);
+    if (status != SUCCESS) {
+        return status;
+    }
+    if (!ota_patch_is_finished(&ctx)) {
+        return ATT_ERR_INVALID_VALUE_SIZE; // Instructions left after the expected output
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Start applying patch instructions
+ *
+ * @param ctx Pointer to the patch engine state
+ * @param in Pointer to the patch instructions, must stay untouched while applying
+ * @param in_length Length of the patch instructions
+ * @param source_entry Entry address of the running bank
+ */
+void ota_patch_init(ota_patch_ctx_t *ctx, const uint8_t *in, uint32_t in_length, uint32_t source_entry) {
+    ctx->in = in;
+    ctx->in_length = in_length;
+    ctx->in_offset = 0;
+    ctx->source_entry = source_entry;
+    ctx->source_address = source_entry;
+    ctx->remaining = 0;
+    ctx->run_remaining = 0;
+    ctx->opcode = 0;
+    ctx->run_delta = 0;
+}
+
+/**
+ * @brief Apply the patch instructions to produce the next slice of output
+ * An instruction may span several slices.
+ *
+ * @param ctx Pointer to the patch engine state
+ * @param out Pointer to the output slice, NULL to only walk the instructions
+ * @param out_length Number of bytes to produce
+ *
+ * @return bStatus_t Result of the patching
+ */
+bStatus_t ota_patch_apply(ota_patch_ctx_t *ctx, uint8_t *out, uint32_t out_length) {
+    uint32_t produced = 0;
+    uint8_t value = 0;
+    bStatus_t status;
+
+    while (produced < out_length) {
+        if (ctx->remaining == 0) {
+            status = ota_patch_next_instruction(ctx);
+            if (status != SUCCESS) {
+                return status;
+            }
+        }
+        if (ctx->opcode == OTA_PATCH_OP_DIFF && ctx->run_remaining == 0) {
+            status = ota_patch_next_run(ctx);
+            if (status != SUCCESS) {
+                return status;
+            }
+        }
+
+        // Code flash is memory mapped, the running bank is read in place
+        switch (ctx->opcode) {
+            case OTA_PATCH_OP_COPY:
+                if (out != NULL) {
+                    value = *(const uint8_t *)(uintptr_t)ctx->source_address;
+                }
+                ctx->source_address++;
+                break;
+            case OTA_PATCH_OP_INSERT:
+                if (ctx->in_offset >= ctx->in_length) {
+                    return ATT_ERR_INVALID_VALUE;
+                }
+                value = ctx->in[ctx->in_offset++];
+                break;
+            default:
+                if (out != NULL) {
+                    value = *(const uint8_t *)(uintptr_t)ctx->source_address;
+                }
+                if (ctx->run_delta) {
+                    if (ctx->in_offset >= ctx->in_length) {
+                        return ATT_ERR_INVALID_VALUE;
+                    }
+                    value += ctx->in[ctx->in_offset++];
+                }
+                ctx->source_address++;
+                ctx->run_remaining--;
+                break;
+        }
+
+        if (out != NULL) {
+            out[produced] = value;
+        }
+        produced++;
+        ctx->remaining--;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Check if all patch instructions have been consumed
+ *
+ * @param ctx Pointer to the patch engine state
+ *
+ * @return uint32_t 1 if all instructions are consumed and none is pending, 0 otherwise
+ */
+uint32_t ota_patch_is_finished(const ota_patch_ctx_t *ctx) {
+    return ctx->remaining == 0 && ctx->in_offset == ctx->in_length;
+}
@@ -0,0 +1,222 @@
+// ota_progress.c
+// This file contains the implementation of the persistent OTA progress map of the inactive flash bank.
+// The map lets a host resume an interrupted update from the first incomplete page.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ota_progress.h"
+#include "eeprom_flags.h"
+
+__attribute__((aligned(8))) static ota_progress_map_t progress_map;
+static uint32_t progress_map_already_read = 0;
+static uint32_t progress_map_dirty = 0; // Map has changes that are not in EEPROM yet
+
+// Range programmed without a gap since the last break, a page is only complete once the run covers it from its first byte
+static uint32_t progress_run_start = 0;
+static uint32_t progress_run_end = 0;
+
+/**
+ * @brief Get the flash bank that is being updated
+ * 
+ * @return current_flash_bank_t The flash bank that is not currently active
+ */
+static current_flash_bank_t ota_progress_target_bank(void)
+{
+    return ota_get_flags_current_flash_bank() == FLASH_BANK_A ? FLASH_BANK_B : FLASH_BANK_A;
+}
+
+/**
+ * @brief Load the progress map from EEPROM
+ * A map that belongs to the other bank is stale, e.g. after the banks have been switched, and starts over.
+ */
+static void ota_progress_load(void)
+{
+    EEPROM_READ(OTA_EEPROM_FLASH_OFFSET_PROGRESS, (uint32_t *)&progress_map, OTA_EEPROM_FLASH_PROGRESS_LEN);
+    if (progress_map.target_flash_bank != ota_progress_target_bank())
+    {
+        tmos_memset(&progress_map, 0xFF, sizeof(progress_map));
+        progress_map.target_flash_bank = ota_progress_target_bank();
+    }
+    progress_map_already_read = 1;
+}
+
+/**
+ * @brief Save the progress map to EEPROM
+ */
+static void ota_progress_save(void)
+{
+    // 256 bytes is the size of the EEPROM page
+    EEPROM_ERASE(OTA_EEPROM_FLASH_OFFSET_PROGRESS, OTA_EEPROM_FLASH_ERASE_SIZE);
+    EEPROM_WRITE(OTA_EEPROM_FLASH_OFFSET_PROGRESS, (uint32_t *)&progress_map, OTA_EEPROM_FLASH_PROGRESS_LEN);
+    progress_map_dirty = 0;
+}
+
+/**
+ * @brief Save the progress map to EEPROM if it has changed since the last save
+ * Called once the OTA engine goes idle, so back-to-back program operations cost one EEPROM page erase
+ * instead of one per completed page. Completed pages lost with a power cycle only make the host redo them.
+ */
+void ota_progress_flush(void)
+{
+    if (progress_map_dirty)
+        ota_progress_save();
+}
+
+/**
+ * @brief Get the flash address of a page of the inactive bank
+ * 
+ * @param index Index of the page
+ * 
+ * @return uint32_t Flash address of the first byte of the page
+ */
+static uint32_t ota_progress_page_address(uint32_t index)
+{
+    uint32_t entry = progress_map.target_flash_bank == FLASH_BANK_A ? OTA_FLASH_BANK_A_ENTRY : OTA_FLASH_BANK_B_ENTRY;
+    return entry + index * OTA_PROGRESS_PAGE_SIZE;
+}
+
+/**
+ * @brief Get the range of pages of the inactive bank touched by an address range
+ * 
+ * @param address Start address of the range
+ * @param length Length of the range
+ * @param first Pointer to store the index of the first page
+ * @param last Pointer to store the index of the last page
+ * 
+ * @return uint32_t 1 if the range touches the inactive bank, 0 otherwise
+ */
+static uint32_t ota_progress_page_range(uint32_t address, uint32_t length, uint32_t *first, uint32_t *last)
+{
+    uint32_t entry = ota_progress_page_address(0);
+
+    if (length == 0 || address < entry || address - entry >= OTA_FLASH_BANK_SIZE)
+        return 0; // Not in the inactive bank, commands have already checked this
+    if (length > OTA_FLASH_BANK_SIZE - (address - entry))
+        length = OTA_FLASH_BANK_SIZE - (address - entry);
+
+    *first = (address - entry) / OTA_PROGRESS_PAGE_SIZE;
+    *last = (address - entry + length - 1) / OTA_PROGRESS_PAGE_SIZE;
+    return 1;
+}
+
+/**
+ * @brief Get the progress map of the inactive flash bank
+ * 
+ * @return const ota_progress_map_t* Pointer to the progress map
+ */
+const ota_progress_map_t *ota_progress_get_map(void)
+{
+    if (!progress_map_already_read)
+        ota_progress_load();
+    return &progress_map;
+}
+
+/**
+ * @brief Record an erased range, every page touched by it starts over
+ * Saved right away, a map that still shows erased data as programmed would make a resumed update skip it.
+ * 
+ * @param address Start address of the erased range
+ * @param length Length of the erased range
+ */
+void ota_progress_mark_erased(uint32_t address, uint32_t length)
+{
+    uint32_t first, last, changed = 0;
+
+    if (!progress_map_already_read)
+        ota_progress_load();
+    if (!ota_progress_page_range(address, length, &first, &last))
+        return;
+
+    // Data programmed so far may be gone, the next program operation starts a new run
+    if (address < progress_run_end && address + length > progress_run_start)
+    {
+        progress_run_start = 0;
+        progress_run_end = 0;
+    }
+
+    // Flash erases whole blocks, so every touched page starts over
+    for (uint32_t i = first; i <= last; i++)
+    {
+        uint8_t state = 0xFF & ~OTA_PROGRESS_STATE_ERASED;
+        changed |= progress_map.pages[i] != state;
+        progress_map.pages[i] = state;
+    }
+    if (changed)
+        ota_progress_save();
+}
+
+/**
+ * @brief Record a programmed range
+ * Pages covered from their first to their last byte by the current run are complete,
+ * any touched page needs to be verified again.
+ * Completed pages are saved by ota_progress_flush, a lost verified state is saved right away.
+ * 
+ * @param address Start address of the programmed range
+ * @param length Length of the programmed range
+ */
+void ota_progress_mark_programmed(uint32_t address, uint32_t length)
+{
+    uint32_t first, last, changed = 0, unverified = 0;
+
+    if (!progress_map_already_read)
+        ota_progress_load();
+    if (!ota_progress_page_range(address, length, &first, &last))
+        return;
+
+    // Extend the run if the range continues or overlaps it, otherwise the range starts a new run
+    if (address >= progress_run_start && address <= progress_run_end)
+    {
+        if (address + length > progress_run_end)
+            progress_run_end = address + length;
+    }
+    else
+    {
+        progress_run_start = address;
+        progress_run_end = address + length;
+    }
+
+    for (uint32_t i = first; i <= last; i++)
+    {
+        uint8_t state = progress_map.pages[i] | OTA_PROGRESS_STATE_VERIFIED; // New data is not verified yet
+        // A page is only complete if no byte in front of the range is missing
+        if (progress_run_start <= ota_progress_page_address(i) && progress_run_end >= ota_progress_page_address(i + 1))
+            state &= ~OTA_PROGRESS_STATE_PROGRAMMED;
+        unverified |= (progress_map.pages[i] & OTA_PROGRESS_STATE_VERIFIED) == 0;
+        changed |= progress_map.pages[i] != state;
+        progress_map.pages[i] = state;
+    }
+    if (unverified)
+        ota_progress_save(); // A resumed update must never skip a page that changed after its verify
+    else if (changed)
+        progress_map_dirty = 1;
+}
+
+/**
+ * @brief Record a verified range, complete pages fully inside it are verified
+ * 
+ * @param address Start address of the verified range
+ * @param length Length of the verified range
+ */
+void ota_progress_mark_verified(uint32_t address, uint32_t length)
+{
+    uint32_t first, last, changed = 0;
+
+    if (!progress_map_already_read)
+        ota_progress_load();
+    if (!ota_progress_page_range(address, length, &first, &last))
+        return;
+
+    for (uint32_t i = first; i <= last; i++)
+    {
+        uint8_t state = progress_map.pages[i];
+        if (address > ota_progress_page_address(i) || address + length < ota_progress_page_address(i + 1))
+            continue; // Page is only partially covered by the verified range
+        if (state & OTA_PROGRESS_STATE_PROGRAMMED)
+            continue; // Nothing to verify on an incomplete page
+        state &= ~OTA_PROGRESS_STATE_VERIFIED;
+        changed |= progress_map.pages[i] != state;
+        progress_map.pages[i] = state;
+    }
+    if (changed)
+        ota_progress_save();
+}
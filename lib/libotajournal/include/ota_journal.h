@@ -0,0 +1,39 @@
+// ota_journal.h
+// This file contains the definitions and function prototypes for the append-only record journal in data flash.
+// Shared by libota and the bootloader, so it depends on nothing but the CH58x peripheral library.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef __OTA_JOURNAL_H__
+#define __OTA_JOURNAL_H__
+
+#include "CH58x_common.h"
+
+// Journal record layout, records never cross a data flash page:
+//   magic (4 bytes) + sequence (4 bytes) + data (data_length bytes) + CRC-32 of all previous fields (4 bytes)
+// Records are appended to the pages as a ring, the valid record with the highest sequence wins.
+// A page is only erased when the ring wraps into it, a torn record simply fails its CRC.
+#define OTA_JOURNAL_MAGIC 0x4C4E524A // "JRNL"
+#define OTA_JOURNAL_MAX_DATA_LEN 48
+#define OTA_JOURNAL_RECORD_LEN(data_length) (sizeof(uint32_t) + sizeof(uint32_t) + (data_length) + sizeof(uint32_t))
+
+typedef struct _ota_journal_t
+{
+    uint32_t base; // EEPROM offset of the first page, page aligned
+    uint32_t page_count; // Number of EEPROM pages in the ring
+    uint32_t data_length; // Length of the record data, multiple of 4, at most OTA_JOURNAL_MAX_DATA_LEN
+    uint32_t scanned; // Position of the newest record is known
+    uint32_t page; // Page of the newest record
+    uint32_t slot; // Slot of the newest record in its page, the number of slots per page if there is none
+    uint32_t sequence; // Sequence of the newest record
+} ota_journal_t;
+
+#define OTA_JOURNAL_INIT(base, page_count, data_length) { (base), (page_count), (data_length), 0, 0, 0, 0 }
+
+// Read the data of the newest valid record, returns 0 if the journal is empty
+uint32_t ota_journal_read(ota_journal_t *journal, void *data);
+
+// Append a record with new data
+void ota_journal_write(ota_journal_t *journal, const void *data);
+
+#endif // __OTA_JOURNAL_H__
@@ -0,0 +1,222 @@
+// ota_journal.c
+// This file contains the implementation of the append-only record journal in data flash.
+// Used for the OTA EEPROM flags by libota and the bootloader, a flag update costs one record write instead of a page erase.
+// Author: Iluna Angelic47 <admin@angelic47.com>
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ota_journal.h"
+
+#define OTA_JOURNAL_RECORD_WORDS (OTA_JOURNAL_RECORD_LEN(OTA_JOURNAL_MAX_DATA_LEN) / sizeof(uint32_t))
+
+// Record buffer, EEPROM_READ and EEPROM_WRITE work on words
+__attribute__((aligned(4))) static uint32_t journal_record[OTA_JOURNAL_RECORD_WORDS];
+
+/**
+ * @brief CRC-32 (IEEE 802.3, as zlib) of a buffer
+ * Bitwise on purpose, records are small and the bootloader has to fit in 12K.
+ *
+ * @param data Pointer to the data
+ * @param length Length of the data
+ *
+ * @return uint32_t CRC-32 of the data
+ */
+static uint32_t ota_journal_crc32(const uint8_t *data, uint32_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    uint32_t i, bit;
+
+    for (i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Get the EEPROM offset of a record slot
+ *
+ * @param journal Pointer to the journal
+ * @param page Page of the slot
+ * @param slot Slot in the page
+ *
+ * @return uint32_t EEPROM offset of the slot
+ */
+static uint32_t ota_journal_slot_offset(const ota_journal_t *journal, uint32_t page, uint32_t slot)
+{
+    return journal->base + page * EEPROM_PAGE_SIZE + slot * OTA_JOURNAL_RECORD_LEN(journal->data_length);
+}
+
+/**
+ * @brief Get the number of record slots in a page
+ *
+ * @param journal Pointer to the journal
+ *
+ * @return uint32_t Number of record slots in a page
+ */
+static uint32_t ota_journal_slots(const ota_journal_t *journal)
+{
+    return EEPROM_PAGE_SIZE / OTA_JOURNAL_RECORD_LEN(journal->data_length);
+}
+
+/**
+ * @brief Read a record slot into the record buffer and check it
+ *
+ * @param journal Pointer to the journal
+ * @param page Page of the slot
+ * @param slot Slot in the page
+ * @param sequence Pointer to store the sequence of the record
+ *
+ * @return uint32_t 1 if the slot holds a valid record, 0 otherwise
+ */
+static uint32_t ota_journal_read_slot(const ota_journal_t *journal, uint32_t page, uint32_t slot, uint32_t *sequence)
+{
+    uint32_t words = journal->data_length / sizeof(uint32_t) + 2;
+
+    EEPROM_READ(ota_journal_slot_offset(journal, page, slot), journal_record, OTA_JOURNAL_RECORD_LEN(journal->data_length));
+    if (journal_record[0] != OTA_JOURNAL_MAGIC)
+        return 0; // Blank slot or some other data
+    if (journal_record[words] != ota_journal_crc32((const uint8_t *)journal_record, words * sizeof(uint32_t)))
+        return 0; // Torn write
+    *sequence = journal_record[1];
+    return 1;
+}
+
+/**
+ * @brief Check if a record slot has never been written since its page was erased
+ *
+ * @param journal Pointer to the journal
+ * @param page Page of the slot
+ * @param slot Slot in the page
+ *
+ * @return uint32_t 1 if the slot is blank, 0 otherwise
+ */
+static uint32_t ota_journal_slot_blank(const ota_journal_t *journal, uint32_t page, uint32_t slot)
+{
+    uint32_t words = OTA_JOURNAL_RECORD_LEN(journal->data_length) / sizeof(uint32_t);
+    uint32_t i;
+
+    EEPROM_READ(ota_journal_slot_offset(journal, page, slot), journal_record, OTA_JOURNAL_RECORD_LEN(journal->data_length));
+    for (i = 0; i < words; i++)
+    {
+        if (journal_record[i] != 0xFFFFFFFF)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Find the newest valid record of the journal
+ * Pages fill in order and a page is erased before its first slot is written,
+ * so the first slots tell which page is the newest and only that page is scanned.
+ *
+ * @param journal Pointer to the journal
+ */
+static void ota_journal_scan(ota_journal_t *journal)
+{
+    uint32_t slots = ota_journal_slots(journal);
+    uint32_t page, slot, sequence;
+    uint32_t found = 0;
+
+    journal->page = 0;
+    journal->slot = slots; // No record yet, the first write goes to page 0 slot 0
+    journal->sequence = 0;
+
+    for (page = 0; page < journal->page_count; page++)
+    {
+        if (!ota_journal_read_slot(journal, page, 0, &sequence))
+            continue;
+        // Wrap safe comparison, the sequence only ever grows by one
+        if (!found || (int32_t)(sequence - journal->sequence) > 0)
+        {
+            found = 1;
+            journal->page = page;
+            journal->slot = 0;
+            journal->sequence = sequence;
+        }
+    }
+
+    if (found)
+    {
+        for (slot = 1; slot < slots; slot++)
+        {
+            if (!ota_journal_read_slot(journal, journal->page, slot, &sequence))
+                continue; // Torn slots are skipped by the writer, keep looking behind them
+            if ((int32_t)(sequence - journal->sequence) > 0)
+            {
+                journal->slot = slot;
+                journal->sequence = sequence;
+            }
+        }
+    }
+
+    journal->scanned = 1;
+}
+
+/**
+ * @brief Read the data of the newest valid record
+ *
+ * @param journal Pointer to the journal
+ * @param data Pointer to store the record data, data_length bytes
+ *
+ * @return uint32_t 1 if a record was read, 0 if the journal holds no valid record
+ */
+uint32_t ota_journal_read(ota_journal_t *journal, void *data)
+{
+    uint32_t sequence;
+
+    if (!journal->scanned)
+        ota_journal_scan(journal);
+    if (journal->slot >= ota_journal_slots(journal))
+        return 0; // Empty journal
+
+    if (!ota_journal_read_slot(journal, journal->page, journal->slot, &sequence))
+        return 0;
+    memcpy(data, &journal_record[2], journal->data_length);
+    return 1;
+}
+
+/**
+ * @brief Append a record with new data
+ * The record goes to the next blank slot, a page is only erased when the ring wraps into it.
+ * A power loss in the middle leaves a record that fails its CRC, and the previous record still wins.
+ *
+ * @param journal Pointer to the journal
+ * @param data Pointer to the record data, data_length bytes
+ */
+void ota_journal_write(ota_journal_t *journal, const void *data)
+{
+    uint32_t slots = ota_journal_slots(journal);
+    uint32_t words = journal->data_length / sizeof(uint32_t) + 2;
+    uint32_t page, slot;
+
+    if (!journal->scanned)
+        ota_journal_scan(journal);
+
+    page = journal->page;
+    slot = journal->slot >= slots ? 0 : journal->slot + 1;
+    if (journal->slot >= slots)
+        EEPROM_ERASE(ota_journal_slot_offset(journal, page, 0), EEPROM_PAGE_SIZE); // Empty journal, may hold data of an older layout
+
+    // Slots written by a torn record are not blank anymore, step over them
+    while (slot < slots && !ota_journal_slot_blank(journal, page, slot))
+        slot++;
+    if (slot >= slots)
+    {
+        // Page is full, compact by moving on to the oldest page
+        page = (page + 1) % journal->page_count;
+        slot = 0;
+        EEPROM_ERASE(ota_journal_slot_offset(journal, page, 0), EEPROM_PAGE_SIZE);
+    }
+
+    journal_record[0] = OTA_JOURNAL_MAGIC;
+    journal_record[1] = journal->sequence + 1;
+    memcpy(&journal_record[2], data, journal->data_length);
+    journal_record[words] = ota_journal_crc32((const uint8_t *)journal_record, words * sizeof(uint32_t));
+    EEPROM_WRITE(ota_journal_slot_offset(journal, page, slot), journal_record, OTA_JOURNAL_RECORD_LEN(journal->data_length));
+
+    journal->page = page;
+    journal->slot = slot;
+    journal->sequence++;
+}
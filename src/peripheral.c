@@ -131,6 +131,9 @@ static uint8_t attDeviceName[GAP_DEVICE_NAME_LEN] = "Simple Peripheral";
 static peripheralConnItem_t peripheralConnList;
 
 static uint8_t peripheralMTU = ATT_MTU_SIZE;
+
+// Boot profile is printed once, at the first advertising start
+static uint8_t bootProfilePrinted = FALSE;
 /*********************************************************************
  * LOCAL FUNCTIONS
  */
@@ -407,6 +410,8 @@ static void Peripheral_ProcessGAPMsg(gapRoleEvent_t *pEvent)
         case GAP_PHY_UPDATE_EVENT:
         {
             PRINT("Phy update Rx:%x Tx:%x ..\n", pEvent->linkPhyUpdate.connRxPHYS, pEvent->linkPhyUpdate.connTxPHYS);
+            ota_link_phy_updated(pEvent->linkPhyUpdate.connectionHandle,
+                                 pEvent->linkPhyUpdate.connTxPHYS, pEvent->linkPhyUpdate.connRxPHYS);
             break;
         }
 
@@ -487,6 +492,11 @@ static void Peripheral_LinkEstablished(gapRoleEvent_t *pEvent)
         // Start read rssi
         tmos_start_task(Peripheral_TaskID, SBP_READ_RSSI_EVT, SBP_READ_RSSI_EVT_PERIOD);
 
+        // Ask for the largest MTU now and for the 2M PHY once the link is settled, for OTA bursts
+        ota_link_connected(event->connectionHandle, Peripheral_TaskID);
+        ota_link_param_updated(event->connectionHandle, event->connInterval, event->connLatency, event->connTimeout);
+        tmos_start_task(Peripheral_TaskID, SBP_PHY_UPDATE_EVT, SBP_PHY_UPDATE_DELAY);
+
         PRINT("Conn %x - Int %x \n", event->connectionHandle, event->connInterval);
     }
 }
@@ -512,6 +522,8 @@ static void Peripheral_LinkTerminated(gapRoleEvent_t *pEvent)
         peripheralConnList.connTimeout = 0;
         tmos_stop_task(Peripheral_TaskID, SBP_PERIODIC_EVT);
         tmos_stop_task(Peripheral_TaskID, SBP_READ_RSSI_EVT);
+        tmos_stop_task(Peripheral_TaskID, SBP_PHY_UPDATE_EVT);
+        ota_link_terminated(event->connectionHandle);
 
         // Restart advertising
         {
@@ -562,6 +574,7 @@ static void peripheralParamUpdateCB(uint16_t connHandle, uint16_t connInterval,
         peripheralConnList.connTimeout = connTimeout;
 
         PRINT("Update %x - Int %x \n", connHandle, connInterval);
+        ota_link_param_updated(connHandle, connInterval, connSlaveLatency, connTimeout);
     }
     else
     {
@@ -596,6 +609,13 @@ static void peripheralStateNotificationCB(gapRole_States_t newState, gapRoleEven
             else if(pEvent->gap.opcode == GAP_MAKE_DISCOVERABLE_DONE_EVENT)
             {
                 PRINT("Advertising..\n");
+                // The first advertising start ends the boot
+                if(!bootProfilePrinted)
+                {
+                    ota_boot_profile_mark(OTA_BOOT_PHASE_APP_ADVERTISING);
+                    ota_boot_profile_print();
+                    bootProfilePrinted = TRUE;
+                }
             }
             break;
 
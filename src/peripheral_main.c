@@ -15,6 +15,7 @@
 #include "gattprofile.h"
 #include "peripheral.h"
 #include "app_usb.h"
+#include "libota.h"
 
 /*********************************************************************
  * GLOBAL TYPEDEFS
@@ -74,6 +75,7 @@ void Main_Circulation()
  */
 int main(void)
 {
+    ota_boot_profile_mark(OTA_BOOT_PHASE_APP_MAIN);
 #if(defined(DCDC_ENABLE)) && (DCDC_ENABLE == TRUE)
     PWR_DCDCCfg(ENABLE);
 #endif
@@ -89,6 +91,7 @@ int main(void)
 #endif
     PRINT("%s\n", VER_LIB);
     CH58X_BLEInit();
+    ota_boot_profile_rtc_restart(); // HAL_Init restarts the RTC
     HAL_Init();
     GAPRole_PeripheralInit();
     Peripheral_Init();